@@ -0,0 +1,333 @@
+//--------------------------------------------------------------------------------------
+// File: Source.cpp
+//
+// Headless tracker benchmark. Replays a recorded clip through the tracking pipeline,
+// reporting per-stage timings and throughput, and writing the tracked positions for
+// every frame so they can be compared between builds.
+//
+// Usage: Benchmark <clip|image pattern|camera number> [-o positions.csv]
+//                  [-s stages.csv] [-c targets.yml] [-h histogram.yml]...
+//                  [-p pyramidLevel] [-w] [-l lookupBits] [-t stripes] [-m]
+//                  [-r] [-i maxDirtyRatio] [-P params.yml] [-a]
+//        Benchmark <left clip> -S <right clip> <calibration.yml> [-o positions.csv]
+//                  [-c targets.yml] [-P params.yml]
+//--------------------------------------------------------------------------------------
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+#include "../Code/BackProjectLUT.h"
+#include "../Code/FrameSource.h"
+#include "../Code/HistogramAdapter.h"
+#include "../Code/HistogramCache.h"
+#include "../Code/MotionGate.h"
+#include "../Code/OpenCVToolkit.h"
+#include "../Code/PipelineProfiler.h"
+#include "../Code/StereoTracker.h"
+#include "../Code/TargetSet.h"
+#include "../Code/TrackerParams.h"
+
+//--------------------------------------------------------------------------------------
+// Timing totals for a single pipeline stage
+//--------------------------------------------------------------------------------------
+struct StageTime {
+    std::string name;
+    double total = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    int count = 0;
+
+    void add(double ms) {
+        min = count == 0 ? ms : std::min(min, ms);
+        max = count == 0 ? ms : std::max(max, ms);
+        total += ms;
+        count++;
+    };
+};
+
+// Stages around the pipeline, which times its own stages through the profiler
+enum FrameStage { FRAME_READ, FRAME_FLIP, FRAME_GATE, FRAME_TRACK, FRAME_ADAPT, FRAME_STAGE_COUNT };
+
+static double elapsedMs(int64 start) {
+
+    return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+}
+
+//--------------------------------------------------------------------------------------
+// Replay a pair of clips through the stereo tracker, writing the triangulated positions of
+// every pair of frames
+//--------------------------------------------------------------------------------------
+static int runStereo(const std::string &leftClip, const std::string &rightClip, const std::string &calibrationPath,
+    const std::string &targetConfig, const std::string &paramsPath, const std::string &positionsPath) {
+
+    StereoTracker stereo(targetConfig, paramsPath);
+    if (!stereo.LoadCalibration(calibrationPath) || !stereo.InitSources(openFrameSource(leftClip), openFrameSource(rightClip))) {
+        return -1;
+    }
+
+    std::ofstream positions(positionsPath.c_str());
+    positions << "frame,target,left_x,left_y,right_x,right_y,triangulated,x,y,z" << std::endl;
+
+    int64 start = cv::getTickCount();
+    int frames = 0;
+    int triangulated = 0;
+    stereo.StartCaptureThreads();
+    while (stereo.WaitForPair()) {
+        const StereoSnapshot &pair = stereo.getPair();
+        for (size_t i = 0; i < pair.results.size(); i++) {
+            const StereoResult &result = pair.results[i];
+            positions << frames << "," << i << "," << std::fixed << std::setprecision(2)
+                << pair.views[0][i].centroid.x << "," << pair.views[0][i].centroid.y << ","
+                << pair.views[1][i].centroid.x << "," << pair.views[1][i].centroid.y << ","
+                << (result.triangulated ? 1 : 0) << "," << std::setprecision(4)
+                << result.position.x << "," << result.position.y << "," << result.position.z << std::endl;
+            triangulated += result.triangulated ? 1 : 0;
+        }
+        frames++;
+    }
+    stereo.StopCaptureThreads();
+    double elapsed = elapsedMs(start);
+
+    std::cout << "Frame pairs: " << frames << ", targets triangulated: " << triangulated << std::endl;
+    if (elapsed > 0.0) {
+        std::cout << "Throughput: " << std::setprecision(1) << frames * 1000.0 / elapsed << " pairs/s" << std::endl;
+    }
+    std::cout << "Positions written to " << positionsPath << std::endl;
+    return 0;
+
+}
+
+int main(int argc, char **argv) {
+
+    if (argc < 2) {
+        std::cout << "Usage: Benchmark <clip|image pattern|camera number> [-o positions.csv] [-s stages.csv] [-c targets.yml] [-h histogram.yml]... [-p pyramidLevel] [-w] [-l lookupBits] [-t stripes] [-m] [-r] [-i maxDirtyRatio] [-P params.yml] [-a] [-S rightClip calibration.yml]" << std::endl;
+        return -1;
+    }
+
+    std::string clip = argv[1];
+    std::string positionsPath = "positions.csv";
+    std::string stagesPath;
+    std::string targetConfig = "../Histograms/targets.yml";
+    vector<std::string> histPaths;
+    int pyramidLevel = 0;
+    bool windowed = false;
+    int lookupBits = 0;
+    int stripes = 1;
+    bool gated = false;
+    bool raw = false;
+    bool incremental = false;
+    float maxDirtyRatio = 0.25f;
+    std::string paramsPath;
+    bool adaptive = false;
+    std::string rightClip;
+    std::string calibrationPath;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            positionsPath = argv[++i];
+        } else if (arg == "-s" && i + 1 < argc) {
+            stagesPath = argv[++i];
+        } else if (arg == "-c" && i + 1 < argc) {
+            targetConfig = argv[++i];
+        } else if (arg == "-h" && i + 1 < argc) {
+            histPaths.push_back(argv[++i]);
+        } else if (arg == "-p" && i + 1 < argc) {
+            pyramidLevel = atoi(argv[++i]);
+        } else if (arg == "-w") {
+            windowed = true;
+        } else if (arg == "-l" && i + 1 < argc) {
+            lookupBits = std::max(5, std::min(atoi(argv[++i]), 8));
+        } else if (arg == "-t" && i + 1 < argc) {
+            stripes = atoi(argv[++i]);
+            stripes = stripes > 0 ? stripes : cv::getNumThreads();
+        } else if (arg == "-m") {
+            gated = true;
+        } else if (arg == "-r") {
+            raw = true;
+        } else if (arg == "-i" && i + 1 < argc) {
+            incremental = true;
+            maxDirtyRatio = (float)atof(argv[++i]);
+        } else if (arg == "-P" && i + 1 < argc) {
+            paramsPath = argv[++i];
+        } else if (arg == "-a") {
+            // Only targets held in a search window are trusted to adapt from
+            adaptive = true;
+            windowed = true;
+        } else if (arg == "-S" && i + 2 < argc) {
+            rightClip = argv[++i];
+            calibrationPath = argv[++i];
+        }
+    }
+    if (!rightClip.empty()) {
+        return runStereo(clip, rightClip, calibrationPath, targetConfig, paramsPath.empty() ? "../Histograms/tracker_params.yml" : paramsPath, positionsPath);
+    }
+    // Tuned parameters, or the built in ones
+    TrackerParams params;
+    if (!paramsPath.empty() && !loadTrackerParams(paramsPath, params)) {
+        return -1;
+    }
+    // Histograms given on the command line replace the target config
+    TargetSet targets;
+    if (histPaths.empty()) {
+        if (!loadTargetSet(targetConfig, targets, lookupBits)) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < histPaths.size(); i++) {
+        cv::MatND hist;
+        int hsvCode;
+        BackProjectLUT lut, yuyvLut;
+        if (!loadCachedHistogram(histPaths[i], lookupBits, hist, hsvCode, lut, yuyvLut)) {
+            return -1;
+        }
+        targets.add(histPaths[i], cv::Scalar::all(255), hist, hsvCode, lut, yuyvLut);
+    }
+    const vector<cv::MatND> &hists = targets.hists;
+    const vector<BackProjectLUT> *lookup = lookupBits ? &targets.luts : nullptr;
+
+    std::unique_ptr<FrameSource> source(openFrameSource(clip));
+    if (!source->isOpened()) {
+        std::cout << "Cannot open " << clip << std::endl;
+        return -1;
+    }
+    // Tables for raw YUYV frames the cache didn't hold, baked before the clip is timed
+    if (raw && source->lendsYUYV()) {
+        targets.buildYUYVLuts(lookupBits ? lookupBits : 6);
+    }
+
+    std::ofstream positions(positionsPath.c_str());
+    positions << "frame,timestamp,target,x,y,width,height,centroid_x,centroid_y,radius" << std::endl;
+
+    StageTime stages[FRAME_STAGE_COUNT];
+    const char *stageNames[FRAME_STAGE_COUNT] = { "read", "flip", "gate", "track", "adapt" };
+    for (int i = 0; i < FRAME_STAGE_COUNT; i++) {
+        stages[i].name = stageNames[i];
+    }
+
+    // Keep the stage timings of the whole clip, rather than a short rolling window
+    PipelineProfiler profiler(1 << 16);
+
+    cv::Mat frame;
+    vector<TrackResult> results;
+    vector<TrackWindow> windows;
+    TrackerWorkspace workspace;
+    MotionGate motionGate;
+    HistogramAdapter adapter;
+    workspace.stripes = stripes;
+    workspace.incremental = incremental;
+    workspace.maxDirtyRatio = maxDirtyRatio;
+    workspace.params = params;
+    workspace.profiler = &profiler;
+    double timestamp;
+    int frames = 0;
+
+    while (true) {
+        int64 start = cv::getTickCount();
+        // Raw frames stay in the camera's layout, lent by the source without a copy
+        if (!source->grab(timestamp) || !(raw ? source->retrieveRaw(frame) : source->retrieve(frame))) {
+            break;
+        }
+        stages[FRAME_READ].add(elapsedMs(start));
+
+        // Raw YUYV frames are lent by the source, so only their results are mirrored
+        const bool unmirrored = frame.type() == CV_8UC2;
+        start = cv::getTickCount();
+        if (unmirrored) {
+            mirrorResults(results, frame.cols);
+        } else {
+            cv::flip(frame, frame, 1);
+        }
+        stages[FRAME_FLIP].add(elapsedMs(start));
+
+        // YUYV frames can only be looked up
+        const vector<BackProjectLUT> *frameLookup = lookup;
+        if (frame.type() == CV_8UC2) {
+            frameLookup = &targets.yuyvLuts;
+        }
+
+        // Results depend on when the adapter thread publishes, so differ from run to run
+        if (adaptive) {
+            if (!adapter.isRunning()) {
+                adapter.start(targets);
+            }
+            adapter.apply(targets);
+        }
+
+        MotionGate *gate = nullptr;
+        if (gated) {
+            start = cv::getTickCount();
+            motionGate.update(frame);
+            gate = &motionGate;
+            stages[FRAME_GATE].add(elapsedMs(start));
+        }
+
+        start = cv::getTickCount();
+        workspace.reserve(frame.size(), hists.size());
+        if (windowed) {
+            updateTracksAndSizes(frame, hists, results, windows, pyramidLevel, frameLookup, &workspace, gate);
+        } else {
+            updateTracksAndSizes(frame, hists, results, pyramidLevel, frameLookup, &workspace, gate);
+        }
+        stages[FRAME_TRACK].add(elapsedMs(start));
+
+        if (adaptive) {
+            start = cv::getTickCount();
+            adapter.fold(frame, results, windows);
+            stages[FRAME_ADAPT].add(elapsedMs(start));
+        }
+        if (unmirrored) {
+            mirrorResults(results, frame.cols);
+        }
+
+        for (size_t i = 0; i < results.size(); i++) {
+            positions << frames << "," << std::fixed << std::setprecision(4) << timestamp << "," << i << ","
+                << results[i].point.x << "," << results[i].point.y << ","
+                << results[i].size.width << "," << results[i].size.height << ","
+                << results[i].centroid.x << "," << results[i].centroid.y << "," << results[i].radius << std::endl;
+        }
+        frames++;
+    }
+    adapter.stop();
+
+    // Report
+    std::cout << "Frames: " << frames << ", stripes: " << stripes << std::endl;
+    std::cout << std::left << std::setw(14) << "stage" << std::right << std::setw(10) << "mean ms" << std::setw(10) << "min ms"
+        << std::setw(10) << "max ms" << std::setw(10) << "p95 ms" << std::setw(10) << "p99 ms" << std::endl;
+    for (int i = 0; i < FRAME_STAGE_COUNT; i++) {
+        if (stages[i].count == 0) {
+            continue;
+        }
+        std::cout << std::left << std::setw(14) << stages[i].name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << stages[i].total / stages[i].count
+            << std::setw(10) << stages[i].min
+            << std::setw(10) << stages[i].max << std::endl;
+    }
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        StageStats stats = profiler.getStats((PipelineStage)i);
+        if (stats.samples == 0) {
+            continue;
+        }
+        std::cout << std::left << std::setw(14) << std::string("  ") + PipelineProfiler::stageName((PipelineStage)i) << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << stats.mean
+            << std::setw(10) << stats.min
+            << std::setw(10) << ""
+            << std::setw(10) << stats.p95
+            << std::setw(10) << stats.p99 << std::endl;
+    }
+    if (stages[FRAME_TRACK].total > 0.0) {
+        std::cout << "Throughput: " << std::setprecision(1) << frames * 1000.0 / stages[FRAME_TRACK].total << " frames/s (tracking only)" << std::endl;
+    }
+    if (!stagesPath.empty() && profiler.writeCsv(stagesPath)) {
+        std::cout << "Stage timings written to " << stagesPath << std::endl;
+    }
+    if (gated) {
+        std::cout << "Target updates skipped by the motion gate: " << std::setprecision(1) << motionGate.getSkipRatio() * 100.0 << "%" << std::endl;
+    }
+    std::cout << "Workspace buffers grown while tracking: " << workspace.allocationCount() << std::endl;
+    std::cout << "Positions written to " << positionsPath << std::endl;
+
+    return 0;
+
+}
@@ -0,0 +1,209 @@
+//--------------------------------------------------------------------------------------
+// File: BackProjectLUT.cpp
+//
+// This file contains the implementations for back projecting frames through a lookup
+// table baked from a histogram, skipping the HSV conversion
+//--------------------------------------------------------------------------------------
+
+#include "BackProjectLUT.h"
+
+//--------------------------------------------------------------------------------------
+// Bake a histogram into the table
+//--------------------------------------------------------------------------------------
+void BackProjectLUT::build(const cv::MatND &hsv_hist, int bits, int hsvCode) {
+
+    bake(hsv_hist, bits, hsvCode, false);
+
+}
+
+void BackProjectLUT::buildYUYV(const cv::MatND &hsv_hist, int bits, int hsvCode) {
+
+    bake(hsv_hist, bits, hsvCode, true);
+
+}
+
+// BGR centre colours of one plane of table cells, those whose first channel is c0. YUYV cells
+// are written as pairs of pixels sharing their chroma, then decoded to BGR.
+static void cellColours(int c0, int bits, bool yuyv, cv::Mat &cells, cv::Mat &pairs) {
+
+    const int levels = 1 << bits;
+    const int shift = 8 - bits;
+    const int centre = (1 << shift) / 2;
+    cells.create(levels, levels, CV_8UC3);
+    for (int c1 = 0; c1 < levels; c1++) {
+        uchar *cell = cells.ptr<uchar>(c1);
+        for (int c2 = 0; c2 < levels; c2++, cell += 3) {
+            cell[0] = static_cast<uchar>((c0 << shift) + centre);
+            cell[1] = static_cast<uchar>((c1 << shift) + centre);
+            cell[2] = static_cast<uchar>((c2 << shift) + centre);
+        }
+    }
+    if (yuyv) {
+        pairs.create(levels, levels * 2, CV_8UC2);
+        for (int c1 = 0; c1 < levels; c1++) {
+            const uchar *cell = cells.ptr<uchar>(c1);
+            uchar *pair = pairs.ptr<uchar>(c1);
+            for (int c2 = 0; c2 < levels; c2++, cell += 3, pair += 4) {
+                pair[0] = cell[0];
+                pair[1] = cell[1];
+                pair[2] = cell[0];
+                pair[3] = cell[2];
+            }
+        }
+        cv::cvtColor(pairs, cells, CV_YUV2BGR_YUYV);
+        cv::resize(cells, cells, cv::Size(levels, levels), 0, 0, cv::INTER_NEAREST);
+    }
+
+}
+
+void BackProjectLUT::bake(const cv::MatND &hsv_hist, int bits, int hsvCode, bool yuyv) {
+
+    CV_Assert(bits >= 5 && bits <= 8);
+
+    if (!hsv_hist.data) {
+        release();
+        return;
+    }
+
+    // Back project the centre colour of every cell, one plane of the first channel at a time
+    const int levels = 1 << bits;
+    std::shared_ptr<vector<uchar>> baked = std::make_shared<vector<uchar>>((size_t)levels * levels * levels);
+    cv::Mat cells;
+    cv::Mat pairs;
+    cv::Mat hsv;
+    cv::Mat backProject;
+    for (int c0 = 0; c0 < levels; c0++) {
+        cellColours(c0, bits, yuyv, cells, pairs);
+        cv::cvtColor(cells, hsv, hsvCode);
+        cv::calcBackProject(&hsv, 1, hsv_channels, hsv_hist, backProject, ranges);
+
+        uchar *plane = &(*baked)[(size_t)c0 * levels * levels];
+        for (int c1 = 0; c1 < levels; c1++) {
+            std::copy(backProject.ptr<uchar>(c1), backProject.ptr<uchar>(c1) + levels, plane + c1 * levels);
+        }
+    }
+
+    adopt(&(*baked)[0], bits, baked, yuyv);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Histogram bin of every table cell, binned as the back projection baking them would
+//--------------------------------------------------------------------------------------
+void BackProjectLUT::binCells(int bits, int hsvCode, bool yuyv, int hbins, int sbins, vector<int> &cellBins) {
+
+    CV_Assert(bits >= 5 && bits <= 8);
+
+    int h_lookup[256];
+    int s_lookup[256];
+    buildBinLookup(h_ranges, hbins, h_lookup);
+    buildBinLookup(s_ranges, sbins, s_lookup);
+
+    const int levels = 1 << bits;
+    cellBins.resize((size_t)levels * levels * levels);
+    cv::Mat cells;
+    cv::Mat pairs;
+    cv::Mat hsv;
+    for (int c0 = 0; c0 < levels; c0++) {
+        cellColours(c0, bits, yuyv, cells, pairs);
+        cv::cvtColor(cells, hsv, hsvCode);
+
+        int *plane = &cellBins[(size_t)c0 * levels * levels];
+        for (int c1 = 0; c1 < levels; c1++) {
+            const uchar *pixel = hsv.ptr<uchar>(c1);
+            for (int c2 = 0; c2 < levels; c2++, pixel += 3) {
+                int h = h_lookup[pixel[0]];
+                int s = s_lookup[pixel[1]];
+                plane[c1 * levels + c2] = (h < 0 || s < 0) ? -1 : h * sbins + s;
+            }
+        }
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Use a table baked earlier
+//--------------------------------------------------------------------------------------
+void BackProjectLUT::adopt(const uchar *table, int bits, const std::shared_ptr<const void> &owner, bool yuyv) {
+
+    CV_Assert(table && bits >= 5 && bits <= 8);
+
+    this->table = table;
+    this->bits = bits;
+    storage = owner;
+    this->yuyv = yuyv;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Back project a frame through the tables of every target
+//--------------------------------------------------------------------------------------
+void backProjectLUT(const cv::Mat &frame, const vector<const BackProjectLUT*> &luts, vector<cv::Mat> &backProjects) {
+
+    backProjects.resize(luts.size());
+    for (size_t i = 0; i < luts.size(); i++) {
+        backProjects[i].create(frame.size(), CV_8UC1);
+    }
+    backProjectLUTRows(frame, luts, backProjects, cv::Range(0, frame.rows));
+
+}
+
+//--------------------------------------------------------------------------------------
+// Back project a range of rows, into back projections already created at the frame size
+//--------------------------------------------------------------------------------------
+void backProjectLUTRows(const cv::Mat &frame, const vector<const BackProjectLUT*> &luts, vector<cv::Mat> &backProjects, const cv::Range &rows) {
+
+    const bool yuyv = frame.type() == CV_8UC2;
+    CV_Assert(frame.type() == CV_8UC3 || yuyv);
+
+    const size_t targets = luts.size();
+    int bits = 0;
+    cv::AutoBuffer<const uchar*, 16> tables(targets);
+    for (size_t i = 0; i < targets; i++) {
+        CV_Assert(backProjects[i].size() == frame.size() && backProjects[i].type() == CV_8UC1);
+        tables[i] = luts[i]->data();
+        if (!tables[i]) {
+            backProjects[i].rowRange(rows).setTo(cv::Scalar(0));
+            continue;
+        }
+        CV_Assert(bits == 0 || luts[i]->getBits() == bits);
+        CV_Assert(luts[i]->isYUYV() == yuyv);
+        bits = luts[i]->getBits();
+    }
+
+    // Pairs of YUYV pixels are counted from the left of the whole frame, so a region starting
+    // on an odd column begins with the second pixel of a pair
+    int phase = 0;
+    if (yuyv) {
+        cv::Size whole;
+        cv::Point offset;
+        frame.locateROI(whole, offset);
+        phase = offset.x & 1;
+    }
+
+    // Single pass over the pixels, computing each pixel's table index once for every target
+    cv::AutoBuffer<uchar*, 16> dst(targets);
+    for (int y = rows.start; y < rows.end; y++) {
+        const uchar *src = frame.ptr<uchar>(y);
+        for (size_t i = 0; i < targets; i++) {
+            dst[i] = backProjects[i].ptr<uchar>(y);
+        }
+        for (int x = 0; x < frame.cols; x++) {
+            int idx;
+            if (yuyv) {
+                const uchar *pixel = src + 2 * x;
+                const uchar *pair = pixel - 2 * ((x + phase) & 1);
+                const uchar yuv[3] = { pixel[0], pair[1], pair[3] };
+                idx = BackProjectLUT::index(yuv, bits);
+            } else {
+                idx = BackProjectLUT::index(src + 3 * x, bits);
+            }
+            for (size_t i = 0; i < targets; i++) {
+                if (tables[i]) {
+                    dst[i][x] = tables[i][idx];
+                }
+            }
+        }
+    }
+
+}
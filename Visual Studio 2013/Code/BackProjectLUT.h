@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// File: BackProjectLUT.h
+//
+// This file contains the definitions for back projecting frames through a lookup table
+// baked from a histogram, skipping the HSV conversion
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+
+#include "OpenCVToolkit.h"
+
+//--------------------------------------------------------------------------------------
+// Maps a frame pixel straight to its back projection value. Each channel is quantised to
+// the given number of bits, from 5 (32KB table) up to 8 (16MB, exact). Tables never change
+// once baked, so copies share them. A table is keyed either by a BGR pixel, or by a YUYV
+// pixel's luma and the chroma it shares with its pair.
+//--------------------------------------------------------------------------------------
+class BackProjectLUT {
+public:
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    BackProjectLUT() : bits(0), table(0), yuyv(false) {};
+
+    // Bake a histogram, converting each table cell to HSV with the code the histogram was
+    // trained with. Histograms trained on CV_RGB2HSV_FULL use the whole 0-255 hue range.
+    void build(const cv::MatND &hsv_hist, int bits = 6, int hsvCode = CV_RGB2HSV);
+    // As above, for frames the camera hands over in YUYV
+    void buildYUYV(const cv::MatND &hsv_hist, int bits = 6, int hsvCode = CV_RGB2HSV);
+    // Use a table baked earlier, such as one mapped from a cache file, which owner keeps alive
+    void adopt(const uchar *table, int bits, const std::shared_ptr<const void> &owner, bool yuyv = false);
+    void release() { storage.reset(); table = 0; bits = 0; };
+
+    bool empty() const { return table == 0; };
+    bool isYUYV() const { return yuyv; };
+    int getBits() const { return bits; };
+    const uchar *data() const { return table; };
+    size_t size() const { return table ? (size_t)1 << (3 * bits) : 0; };
+
+    // Histogram bin each table cell's centre colour falls in, -1 where it is outside the histogram's
+    // range, so a table can be patched where bins change rather than baked again
+    static void binCells(int bits, int hsvCode, bool yuyv, int hbins, int sbins, vector<int> &cellBins);
+
+    // Table index of a pixel
+    static int index(const uchar *pixel, int bits) {
+        int shift = 8 - bits;
+        return ((pixel[0] >> shift) << (2 * bits)) | ((pixel[1] >> shift) << bits) | (pixel[2] >> shift);
+    };
+
+private:
+    //--------------------------------------------------------------------------------------
+    // Variables
+    //--------------------------------------------------------------------------------------
+
+    int bits;
+    const uchar *table;
+    std::shared_ptr<const void> storage;
+    bool yuyv;
+
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    void bake(const cv::MatND &hsv_hist, int bits, int hsvCode, bool yuyv);
+};
+
+// Back project a frame for every target in a single pass over its pixels. The tables must share their bit depth,
+// and be keyed by the frame's layout, BGR for CV_8UC3 frames and YUYV for CV_8UC2.
+extern void backProjectLUT(const cv::Mat &frame, const vector<const BackProjectLUT*> &luts, vector<cv::Mat> &backProjects);
+// As above, for a range of rows only, into back projections already created at the frame size, so stripes of the frame can run in parallel
+extern void backProjectLUTRows(const cv::Mat &frame, const vector<const BackProjectLUT*> &luts, vector<cv::Mat> &backProjects, const cv::Range &rows);
@@ -0,0 +1,554 @@
+//--------------------------------------------------------------------------------------
+// File: BitMask.cpp
+//
+// This file contains the implementations for binary masks packed one bit per pixel, and
+// the thresholding, morphology and run labelling done on them
+//--------------------------------------------------------------------------------------
+
+#include "BitMask.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BITMASK_SSE2 1
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static const bool haveSSE2 = cv::checkHardwareSupport(CV_CPU_SSE2);
+
+static const uint64 allBits = ~(uint64)0;
+
+//--------------------------------------------------------------------------------------
+// Bit twiddling
+//--------------------------------------------------------------------------------------
+
+// Index of the lowest set bit, which must exist
+static int lowestBit(uint64 bits) {
+
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#elif defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int index = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+
+}
+
+static int popCount(uint64 bits) {
+
+#if defined(__GNUC__)
+    return __builtin_popcountll(bits);
+#else
+    bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+    bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+    bits = (bits + (bits >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((bits * 0x0101010101010101ULL) >> 56);
+#endif
+
+}
+
+//--------------------------------------------------------------------------------------
+// Size the mask, keeping its storage if it is already big enough
+//--------------------------------------------------------------------------------------
+void BitMask::create(int rows, int cols) {
+
+    this->rows = rows;
+    this->cols = cols;
+    stride = (cols + 63) / 64;
+    words.resize((size_t)rows * stride);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Threshold a range of rows into the mask, 16 pixels to a compare
+//--------------------------------------------------------------------------------------
+void thresholdToMask(const cv::Mat &src, int thresh, BitMask &mask, const cv::Range &rows) {
+
+    CV_Assert(src.type() == CV_8UC1 && src.rows == mask.getRows() && src.cols == mask.getCols());
+    CV_Assert(thresh >= 0 && thresh < 255);
+
+    const int cols = src.cols;
+    const int stride = mask.getStride();
+
+    for (int y = rows.start; y < rows.end; y++) {
+        const uchar *in = src.ptr(y);
+        uint64 *out = mask.row(y);
+
+        int x = 0;
+#ifdef BITMASK_SSE2
+        if (haveSSE2) {
+            // Above the threshold where max(v, thresh + 1) leaves v unchanged
+            __m128i above = _mm_set1_epi8((char)(thresh + 1));
+            for (; x <= cols - 64; x += 64) {
+                uint64 bits = 0;
+                for (int k = 0; k < 4; k++) {
+                    __m128i v = _mm_loadu_si128((const __m128i*)(in + x + k * 16));
+                    __m128i set = _mm_cmpeq_epi8(_mm_max_epu8(v, above), v);
+                    bits |= (uint64)(unsigned)_mm_movemask_epi8(set) << (k * 16);
+                }
+                out[x / 64] = bits;
+            }
+        }
+#endif
+        for (int i = x / 64; i < stride; i++) {
+            uint64 bits = 0;
+            int end = std::min(cols - i * 64, 64);
+            for (int b = 0; b < end; b++) {
+                bits |= (uint64)(in[i * 64 + b] > thresh) << b;
+            }
+            out[i] = bits;
+        }
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// 3x3 erode. Rows are ANDed down the columns, then each bit with its neighbours along the
+// row; pixels past the edges count as set, so they never erode anything.
+//--------------------------------------------------------------------------------------
+void erodeMask(const BitMask &src, BitMask &dst, const cv::Range &rows) {
+
+    CV_Assert(&src != &dst && src.getRows() == dst.getRows() && src.getCols() == dst.getCols());
+
+    const int stride = src.getStride();
+    const uint64 lastMask = src.lastWordMask();
+    cv::AutoBuffer<uint64, 64> column(stride);
+
+    for (int y = rows.start; y < rows.end; y++) {
+        const uint64 *mid = src.row(y);
+        const uint64 *up = y > 0 ? src.row(y - 1) : mid;
+        const uint64 *down = y + 1 < src.getRows() ? src.row(y + 1) : mid;
+        uint64 *out = dst.row(y);
+
+        for (int i = 0; i < stride; i++) {
+            column[i] = up[i] & mid[i] & down[i];
+        }
+        column[stride - 1] |= ~lastMask;
+
+        for (int i = 0; i < stride; i++) {
+            uint64 previous = i > 0 ? column[i - 1] : allBits;
+            uint64 next = i + 1 < stride ? column[i + 1] : allBits;
+            uint64 left = (column[i] << 1) | (previous >> 63);
+            uint64 right = (column[i] >> 1) | (next << 63);
+            out[i] = column[i] & left & right;
+        }
+        out[stride - 1] &= lastMask;
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// 3x3 dilate, ORing in the same order as the erode. Pixels past the edges count as clear.
+//--------------------------------------------------------------------------------------
+void dilateMask(const BitMask &src, BitMask &dst, const cv::Range &rows) {
+
+    CV_Assert(&src != &dst && src.getRows() == dst.getRows() && src.getCols() == dst.getCols());
+
+    const int stride = src.getStride();
+    const uint64 lastMask = src.lastWordMask();
+    cv::AutoBuffer<uint64, 64> column(stride);
+
+    for (int y = rows.start; y < rows.end; y++) {
+        const uint64 *mid = src.row(y);
+        const uint64 *up = y > 0 ? src.row(y - 1) : mid;
+        const uint64 *down = y + 1 < src.getRows() ? src.row(y + 1) : mid;
+        uint64 *out = dst.row(y);
+
+        for (int i = 0; i < stride; i++) {
+            column[i] = up[i] | mid[i] | down[i];
+        }
+
+        for (int i = 0; i < stride; i++) {
+            uint64 previous = i > 0 ? column[i - 1] : 0;
+            uint64 next = i + 1 < stride ? column[i + 1] : 0;
+            uint64 left = (column[i] << 1) | (previous >> 63);
+            uint64 right = (column[i] >> 1) | (next << 63);
+            out[i] = column[i] | left | right;
+        }
+        out[stride - 1] &= lastMask;
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Unpack a range of rows to bytes. Words that are all clear or all set, which is most of
+// them, are filled in one go.
+//--------------------------------------------------------------------------------------
+void maskToMat(const BitMask &mask, cv::Mat &dst, const cv::Range &rows) {
+
+    CV_Assert(dst.type() == CV_8UC1 && dst.rows == mask.getRows() && dst.cols == mask.getCols());
+
+    const int cols = mask.getCols();
+    const int stride = mask.getStride();
+
+    for (int y = rows.start; y < rows.end; y++) {
+        const uint64 *in = mask.row(y);
+        uchar *out = dst.ptr(y);
+
+        for (int i = 0; i < stride; i++) {
+            uchar *word = out + i * 64;
+            int end = std::min(cols - i * 64, 64);
+            if (in[i] == 0 || (end == 64 && in[i] == allBits)) {
+                memset(word, in[i] ? 255 : 0, end);
+                continue;
+            }
+            for (int b = 0; b < end; b++) {
+                word[b] = (in[i] >> b) & 1 ? 255 : 0;
+            }
+        }
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Number of set pixels
+//--------------------------------------------------------------------------------------
+int countMask(const BitMask &mask) {
+
+    int count = 0;
+    for (int y = 0; y < mask.getRows(); y++) {
+        const uint64 *in = mask.row(y);
+        for (int i = 0; i < mask.getStride(); i++) {
+            count += popCount(in[i]);
+        }
+    }
+    return count;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Runs of set pixels, found a word at a time by skipping to the next set and clear bits
+//--------------------------------------------------------------------------------------
+void extractRuns(const BitMask &mask, std::vector<MaskRun> &runs) {
+
+    extractRuns(mask, runs, cv::Range(0, mask.getRows()));
+
+}
+
+void extractRuns(const BitMask &mask, std::vector<MaskRun> &runs, const cv::Range &rows) {
+
+    runs.clear();
+
+    for (int y = rows.start; y < rows.end; y++) {
+        const uint64 *in = mask.row(y);
+        bool inRun = false;
+        int start = 0;
+
+        for (int i = 0; i < mask.getStride(); i++) {
+            uint64 bits = in[i];
+            int base = i * 64;
+
+            // Finish a run carried over from the last word at its first clear bit
+            if (inRun) {
+                if (bits == allBits) {
+                    continue;
+                }
+                int end = lowestBit(~bits);
+                MaskRun run = { y, start, base + end, 0 };
+                runs.push_back(run);
+                inRun = false;
+                bits &= allBits << end;
+            }
+
+            while (bits) {
+                int first = lowestBit(bits);
+                uint64 clear = ~bits & (allBits << first);
+                if (!clear) {
+                    inRun = true;
+                    start = base + first;
+                    break;
+                }
+                int end = lowestBit(clear);
+                MaskRun run = { y, base + first, base + end, 0 };
+                runs.push_back(run);
+                bits &= allBits << end;
+            }
+        }
+
+        if (inRun) {
+            MaskRun run = { y, start, mask.getCols(), 0 };
+            runs.push_back(run);
+        }
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Union-find over run indices, with every run pointing at an earlier one
+//--------------------------------------------------------------------------------------
+static int findRunRoot(std::vector<int> &parent, int run) {
+
+    while (parent[run] != run) {
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+
+}
+
+static void uniteRuns(std::vector<int> &parent, int a, int b) {
+
+    a = findRunRoot(parent, a);
+    b = findRunRoot(parent, b);
+    if (a < b) {
+        parent[b] = a;
+    } else if (b < a) {
+        parent[a] = b;
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Add a run to the stats of its component. The sums along the run are in closed form, so
+// this costs the same for any run length.
+//--------------------------------------------------------------------------------------
+static double sumTo(double n) { return n * (n + 1.0) / 2.0; }
+static double sumSquaresTo(double n) { return n * (n + 1.0) * (2.0 * n + 1.0) / 6.0; }
+
+static void addRun(BlobStats &blob, const MaskRun &run) {
+
+    const double n = run.end - run.start;
+    const double y = run.y;
+    const double sumX = sumTo(run.end - 1) - sumTo(run.start - 1);
+    const double sumXX = sumSquaresTo(run.end - 1) - sumSquaresTo(run.start - 1);
+
+    blob.area += run.end - run.start;
+    blob.left = std::min(blob.left, run.start);
+    blob.right = std::max(blob.right, run.end);
+    blob.bottom = run.y + 1;
+    blob.m10 += sumX;
+    blob.m01 += n * y;
+    blob.m20 += sumXX;
+    blob.m11 += sumX * y;
+    blob.m02 += n * y * y;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Join each run with the runs it touches on the row above, then number the components
+// in the order of their first run
+//--------------------------------------------------------------------------------------
+int labelRuns(std::vector<MaskRun> &runs, std::vector<int> &parent, bool eightConnected, std::vector<BlobStats> *blobs) {
+
+    const int count = (int)runs.size();
+    const int reach = eightConnected ? 1 : 0;
+    parent.resize(count);
+
+    // Runs of the row above, and of the current row
+    int aboveStart = 0, aboveEnd = 0;
+    int rowStart = 0;
+
+    for (int i = 0; i < count; i++) {
+        parent[i] = i;
+
+        if (i > 0 && runs[i].y != runs[i - 1].y) {
+            bool adjacent = runs[i - 1].y == runs[i].y - 1;
+            aboveStart = adjacent ? rowStart : i;
+            aboveEnd = i;
+            rowStart = i;
+        }
+
+        // Runs above are in order, so skip those ending before this one starts and join
+        // until one starts after it ends. The next run may share the last one joined.
+        while (aboveStart < aboveEnd && runs[aboveStart].end + reach <= runs[i].start) {
+            aboveStart++;
+        }
+        for (int j = aboveStart; j < aboveEnd && runs[j].start < runs[i].end + reach; j++) {
+            uniteRuns(parent, i, j);
+        }
+    }
+
+    if (blobs) {
+        blobs->clear();
+    }
+
+    int labels = 0;
+    for (int i = 0; i < count; i++) {
+        if (parent[i] == i) {
+            runs[i].label = labels++;
+            if (blobs) {
+                BlobStats blob = { 0, runs[i].start, runs[i].y, runs[i].end, runs[i].y + 1, 0.0, 0.0, 0.0, 0.0, 0.0 };
+                blobs->push_back(blob);
+            }
+        } else {
+            parent[i] = parent[parent[i]];
+            runs[i].label = runs[parent[i]].label;
+        }
+        if (blobs) {
+            addRun((*blobs)[runs[i].label], runs[i]);
+        }
+    }
+    return labels;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Incremental blobs
+//--------------------------------------------------------------------------------------
+IncrementalBlobs::IncrementalBlobs(int bandRows, float maxDirtyRatio)
+    : bandRows(std::max(bandRows, 1)), maxDirtyRatio(maxDirtyRatio), dirtyRatio(1.f), valid(false) {
+
+}
+
+// Fold the stats of one part of a component into those of another
+static void addBlob(BlobStats &blob, const BlobStats &part) {
+
+    blob.area += part.area;
+    blob.left = std::min(blob.left, part.left);
+    blob.top = std::min(blob.top, part.top);
+    blob.right = std::max(blob.right, part.right);
+    blob.bottom = std::max(blob.bottom, part.bottom);
+    blob.m10 += part.m10;
+    blob.m01 += part.m01;
+    blob.m20 += part.m20;
+    blob.m11 += part.m11;
+    blob.m02 += part.m02;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Size every buffer for masks of the given size
+//--------------------------------------------------------------------------------------
+void IncrementalBlobs::reserve(int rows, int cols) {
+
+    const int bandCount = (rows + bandRows - 1) / bandRows;
+    const cv::Size bandSize(cols, bandRows);
+    // Opened blobs each hold a 2x2 block and are apart, so no two of those start in one 3x3 cell
+    const size_t bandBlobs = (size_t)((cols + 2) / 3) * ((bandRows + 2) / 3);
+
+    previous.reserve(rows, cols);
+    bands.resize(std::max((int)bands.size(), bandCount));
+    for (int b = 0; b < bandCount; b++) {
+        bands[b].runs.reserve(maxMaskRuns(bandSize));
+        bands[b].blobs.reserve(bandBlobs);
+    }
+    dirty.reserve(bandCount);
+    parent.reserve(maxMaskRuns(bandSize));
+    components.reserve(bandBlobs * bandCount);
+    firstComponent.reserve(bandCount);
+    blobIndex.reserve(bandBlobs * bandCount);
+
+}
+
+size_t IncrementalBlobs::capacity() const {
+
+    size_t total = previous.capacity() + bands.capacity() + dirty.capacity() + parent.capacity() + components.capacity() +
+        firstComponent.capacity() + blobIndex.capacity();
+    for (size_t b = 0; b < bands.size(); b++) {
+        total += bands[b].runs.capacity() + bands[b].blobs.capacity();
+    }
+    return total;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Label the bands that changed, then join the components of every band
+//--------------------------------------------------------------------------------------
+void IncrementalBlobs::update(const BitMask &mask, std::vector<BlobStats> &blobs) {
+
+    const int rows = mask.getRows();
+    const int bandCount = (rows + bandRows - 1) / bandRows;
+    blobs.clear();
+    if (bandCount == 0) {
+        return;
+    }
+
+    // A mask of another size shares nothing with the last one
+    bool whole = !valid || previous.getRows() != rows || previous.getCols() != mask.getCols();
+    if (whole) {
+        previous.create(rows, mask.getCols());
+    }
+    if ((int)bands.size() < bandCount) {
+        bands.resize(bandCount);
+    }
+
+    // Compare each band's words with the last mask's, as bands are contiguous in both
+    dirty.assign(bandCount, 1);
+    int dirtyCount = bandCount;
+    if (!whole) {
+        dirtyCount = 0;
+        for (int b = 0; b < bandCount; b++) {
+            const int y0 = b * bandRows;
+            const size_t words = (size_t)(std::min(y0 + bandRows, rows) - y0) * mask.getStride();
+            dirty[b] = !std::equal(mask.row(y0), mask.row(y0) + words, previous.row(y0));
+            dirtyCount += dirty[b];
+        }
+        if (dirtyCount > maxDirtyRatio * bandCount) {
+            dirty.assign(bandCount, 1);
+            dirtyCount = bandCount;
+        }
+    }
+    dirtyRatio = (float)dirtyCount / bandCount;
+
+    for (int b = 0; b < bandCount; b++) {
+        if (!dirty[b]) {
+            continue;
+        }
+        const cv::Range band(b * bandRows, std::min((b + 1) * bandRows, rows));
+        const size_t words = (size_t)band.size() * mask.getStride();
+        std::copy(mask.row(band.start), mask.row(band.start) + words, previous.row(band.start));
+        extractRuns(mask, bands[b].runs, band);
+        labelRuns(bands[b].runs, parent, true, &bands[b].blobs);
+    }
+    valid = true;
+
+    // Number the components band by band, which keeps them in the order of their first run
+    firstComponent.resize(bandCount);
+    int componentCount = 0;
+    for (int b = 0; b < bandCount; b++) {
+        firstComponent[b] = componentCount;
+        componentCount += (int)bands[b].blobs.size();
+    }
+    components.resize(componentCount);
+    for (int i = 0; i < componentCount; i++) {
+        components[i] = i;
+    }
+
+    // Join the runs on the last row of each band with those they touch on the first row of
+    // the next, as labelRuns joins rows
+    for (int b = 1; b < bandCount; b++) {
+        const std::vector<MaskRun> &above = bands[b - 1].runs;
+        const std::vector<MaskRun> &below = bands[b].runs;
+        const int border = b * bandRows;
+
+        size_t aboveStart = above.size();
+        while (aboveStart > 0 && above[aboveStart - 1].y == border - 1) {
+            aboveStart--;
+        }
+        for (size_t i = 0; i < below.size() && below[i].y == border; i++) {
+            while (aboveStart < above.size() && above[aboveStart].end + 1 <= below[i].start) {
+                aboveStart++;
+            }
+            for (size_t j = aboveStart; j < above.size() && above[j].start < below[i].end + 1; j++) {
+                uniteRuns(components, firstComponent[b - 1] + above[j].label, firstComponent[b] + below[i].label);
+            }
+        }
+    }
+
+    // Roots are the first component of each blob, so blobs come out in labelRuns' order
+    blobIndex.resize(componentCount);
+    for (int b = 0; b < bandCount; b++) {
+        for (size_t i = 0; i < bands[b].blobs.size(); i++) {
+            const int component = firstComponent[b] + (int)i;
+            const int root = findRunRoot(components, component);
+            if (root == component) {
+                blobIndex[component] = (int)blobs.size();
+                blobs.push_back(bands[b].blobs[i]);
+            } else {
+                addBlob(blobs[blobIndex[root]], bands[b].blobs[i]);
+            }
+        }
+    }
+
+}
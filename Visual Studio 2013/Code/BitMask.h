@@ -0,0 +1,132 @@
+//--------------------------------------------------------------------------------------
+// File: BitMask.h
+//
+// This file contains the definitions for binary masks packed one bit per pixel, and the
+// thresholding, morphology and run labelling done on them
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+
+#include <opencv2\core\core.hpp>
+
+//--------------------------------------------------------------------------------------
+// A binary image packed 64 pixels to a word, lowest bit first. Every row starts on a new
+// word, and the bits past the last column are always clear.
+//--------------------------------------------------------------------------------------
+class BitMask {
+public:
+    BitMask() : rows(0), cols(0), stride(0) {};
+
+    void create(int rows, int cols);
+    void reserve(int rows, int cols) { words.reserve((size_t)rows * ((cols + 63) / 64)); };
+    size_t capacity() const { return words.capacity(); };
+
+    int getRows() const { return rows; };
+    int getCols() const { return cols; };
+    int getStride() const { return stride; };
+    uint64 *row(int y) { return &words[(size_t)y * stride]; };
+    const uint64 *row(int y) const { return &words[(size_t)y * stride]; };
+
+    // The bits of the last word in each row that hold pixels
+    uint64 lastWordMask() const { return cols % 64 ? (((uint64)1 << (cols % 64)) - 1) : ~(uint64)0; };
+
+private:
+    int rows;
+    int cols;
+    int stride;
+    std::vector<uint64> words;
+};
+
+//--------------------------------------------------------------------------------------
+// A run of set pixels along a row, from start up to but not including end
+//--------------------------------------------------------------------------------------
+struct MaskRun {
+    int y;
+    int start;
+    int end;
+    int label;
+};
+
+//--------------------------------------------------------------------------------------
+// Area, bounding box and raw moments up to second order of a connected component, summed
+// over its pixel coordinates
+//--------------------------------------------------------------------------------------
+struct BlobStats {
+    int area;
+    int left, top, right, bottom;
+    double m10, m01, m20, m11, m02;
+
+    cv::Rect box() const { return cv::Rect(left, top, right - left, bottom - top); };
+    cv::Point2f centroid() const { return cv::Point2f((float)(m10 / area), (float)(m01 / area)); };
+    // Radius of a disc with the same area
+    float radius() const { return (float)std::sqrt(area / CV_PI); };
+};
+
+// Set the bits of the pixels above thresh, for a range of rows of a mask already created at the size of src
+extern void thresholdToMask(const cv::Mat &src, int thresh, BitMask &mask, const cv::Range &rows);
+
+// 3x3 erode and dilate, leaving pixels past the edges out as the default morphology border does.
+// For a range of rows of dst, already created at the size of src, which must be a different mask.
+extern void erodeMask(const BitMask &src, BitMask &dst, const cv::Range &rows);
+extern void dilateMask(const BitMask &src, BitMask &dst, const cv::Range &rows);
+
+// Write a range of rows of a mask out as 0 and 255, into an image already created at its size
+extern void maskToMat(const BitMask &mask, cv::Mat &dst, const cv::Range &rows);
+// Number of set pixels
+extern int countMask(const BitMask &mask);
+
+// Runs of set pixels, in raster order, of the whole mask or a range of its rows
+extern void extractRuns(const BitMask &mask, std::vector<MaskRun> &runs);
+extern void extractRuns(const BitMask &mask, std::vector<MaskRun> &runs, const cv::Range &rows);
+// Label runs with their 4 or 8-connected component, numbered from 0 in the order of each
+// component's first pixel, and optionally sum each component's stats in the same pass.
+// Returns the number of components.
+extern int labelRuns(std::vector<MaskRun> &runs, std::vector<int> &parent, bool eightConnected, std::vector<BlobStats> *blobs = nullptr);
+// Most runs a mask of the given size can hold
+inline size_t maxMaskRuns(cv::Size size) { return (size_t)size.height * ((size.width + 1) / 2); }
+
+//--------------------------------------------------------------------------------------
+// Blob stats of a mask that changes little from one frame to the next. The mask is split
+// into bands of rows, each labelled on its own, and only the bands whose bits changed since
+// the last update are labelled again. Components are then joined across the band borders.
+// When more than maxDirtyRatio of the bands changed, every band is labelled again.
+//--------------------------------------------------------------------------------------
+class IncrementalBlobs {
+public:
+    IncrementalBlobs(int bandRows = 16, float maxDirtyRatio = 0.25f);
+
+    void reserve(int rows, int cols);
+    size_t capacity() const;
+    void setMaxDirtyRatio(float ratio) { maxDirtyRatio = ratio; };
+
+    // 8-connected blobs of the mask, numbered as labelRuns numbers them
+    void update(const BitMask &mask, std::vector<BlobStats> &blobs);
+    // Forget the last mask, so the next update labels every band
+    void reset() { valid = false; };
+    // Fraction of the bands labelled again by the last update
+    float getDirtyRatio() const { return dirtyRatio; };
+
+private:
+    // Runs of a band labelled within the band, and the stats of its components
+    struct Band {
+        std::vector<MaskRun> runs;
+        std::vector<BlobStats> blobs;
+    };
+
+    int bandRows;
+    float maxDirtyRatio;
+    float dirtyRatio;
+    bool valid;
+    BitMask previous;
+    std::vector<Band> bands;
+    std::vector<unsigned char> dirty;
+
+    // Union-find over the components of every band, numbered band by band, and the blob
+    // each root component ends up as
+    std::vector<int> parent;
+    std::vector<int> components;
+    std::vector<int> firstComponent;
+    std::vector<int> blobIndex;
+};
@@ -0,0 +1,381 @@
+//--------------------------------------------------------------------------------------
+// File: FrameSource.cpp
+//
+// This file contains the implementations for the sources of frames fed to the tracker
+//--------------------------------------------------------------------------------------
+
+#include "FrameSource.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#endif
+
+//--------------------------------------------------------------------------------------
+// Clock used to stamp live frames, in seconds
+//--------------------------------------------------------------------------------------
+double FrameSource::now() {
+
+    return cv::getTickCount() / cv::getTickFrequency();
+
+}
+
+//--------------------------------------------------------------------------------------
+// Camera
+//--------------------------------------------------------------------------------------
+CameraSource::CameraSource(int device, cv::Size resolution) : capture(device) {
+
+    if (capture.isOpened() && resolution.area() > 0) {
+        capture.set(CV_CAP_PROP_FRAME_WIDTH, resolution.width);
+        capture.set(CV_CAP_PROP_FRAME_HEIGHT, resolution.height);
+    }
+
+}
+
+bool CameraSource::grab(double &timestamp) {
+
+    if (!capture.grab()) {
+        return false;
+    }
+
+    // The frame was captured when the grab returned
+    timestamp = now();
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Video file
+//--------------------------------------------------------------------------------------
+VideoFileSource::VideoFileSource(const std::string &path) : capture(path), frameNumber(0) {
+
+    double fps = capture.get(CV_CAP_PROP_FPS);
+    frameTime = fps > 0.0 ? 1.0 / fps : 1.0 / 30.0;
+
+}
+
+bool VideoFileSource::grab(double &timestamp) {
+
+    if (!capture.grab()) {
+        return false;
+    }
+
+    // Stamp frames by their place in the recording, so replays are deterministic
+    timestamp = frameNumber++ * frameTime;
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Image sequence
+//--------------------------------------------------------------------------------------
+ImageSequenceSource::ImageSequenceSource(const std::string &pattern, double fps) : fps(fps), next(0) {
+
+    std::string glob = pattern;
+    if (glob.find('*') == std::string::npos && glob.find('?') == std::string::npos) {
+        glob += "/*";
+    }
+    try {
+        cv::glob(glob, files);
+    } catch (const cv::Exception &) {
+        std::cout << "unable to open image sequence " << pattern << std::endl;
+    }
+
+}
+
+bool ImageSequenceSource::grab(double &timestamp) {
+
+    if (next >= (int)files.size()) {
+        return false;
+    }
+
+    timestamp = next++ / fps;
+    return true;
+
+}
+
+bool ImageSequenceSource::retrieve(cv::Mat &frame) {
+
+    if (next == 0 || next > (int)files.size()) {
+        return false;
+    }
+
+    frame = cv::imread(files[next - 1]);
+    return !frame.empty();
+
+}
+
+//--------------------------------------------------------------------------------------
+// Raw YUYV file
+//--------------------------------------------------------------------------------------
+RawFileSource::RawFileSource(const std::string &path, cv::Size size, double fps)
+    : size(size), fps(fps), frameCount(0), next(0) {
+
+    if (size.area() <= 0 || size.width % 2 != 0 || !file.open(path)) {
+        std::cout << "unable to open raw frames " << path << std::endl;
+        return;
+    }
+    // A partly written last frame is dropped
+    frameCount = file.size / ((size_t)size.area() * 2);
+
+}
+
+bool RawFileSource::grab(double &timestamp) {
+
+    if (next >= frameCount) {
+        return false;
+    }
+
+    timestamp = next++ / fps;
+    return true;
+
+}
+
+bool RawFileSource::retrieveRaw(cv::Mat &frame) {
+
+    if (next == 0 || next > frameCount) {
+        return false;
+    }
+
+    // The mapping is read only, which the header can't express, so the frame must not be written to
+    const uchar *start = file.data + (next - 1) * (size_t)size.area() * 2;
+    frame = cv::Mat(size, CV_8UC2, const_cast<uchar*>(start));
+    return true;
+
+}
+
+bool RawFileSource::retrieve(cv::Mat &frame) {
+
+    cv::Mat raw;
+    if (!retrieveRaw(raw)) {
+        return false;
+    }
+    cv::cvtColor(raw, frame, CV_YUV2BGR_YUYV);
+    return true;
+
+}
+
+#ifdef __linux__
+//--------------------------------------------------------------------------------------
+// V4L2 camera
+//--------------------------------------------------------------------------------------
+static int xioctl(int fd, unsigned long request, void *arg) {
+
+    int result;
+    do {
+        result = ioctl(fd, request, arg);
+    } while (result == -1 && errno == EINTR);
+    return result;
+
+}
+
+V4L2Source::V4L2Source(const std::string &device, cv::Size resolution) : fd(-1), stride(0), current(-1) {
+
+    if (!start(device, resolution)) {
+        std::cout << "unable to stream YUYV from " << device << std::endl;
+        release();
+    }
+
+}
+
+bool V4L2Source::start(const std::string &device, cv::Size resolution) {
+
+    fd = open(device.c_str(), O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+
+    v4l2_capability capability = {};
+    if (xioctl(fd, VIDIOC_QUERYCAP, &capability) == -1 ||
+        !(capability.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(capability.capabilities & V4L2_CAP_STREAMING)) {
+        return false;
+    }
+
+    // Keep the current resolution unless asked for another, but always in YUYV
+    v4l2_format format = {};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(fd, VIDIOC_G_FMT, &format) == -1) {
+        return false;
+    }
+    if (resolution.area() > 0) {
+        format.fmt.pix.width = resolution.width;
+        format.fmt.pix.height = resolution.height;
+    }
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+    if (xioctl(fd, VIDIOC_S_FMT, &format) == -1 || format.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV) {
+        return false;
+    }
+    size = cv::Size(format.fmt.pix.width, format.fmt.pix.height);
+    stride = format.fmt.pix.bytesperline;
+
+    // A few buffers, so the driver can keep filling one while another is lent out
+    v4l2_requestbuffers request = {};
+    request.count = 4;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd, VIDIOC_REQBUFS, &request) == -1 || request.count < 2) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < request.count; i++) {
+        v4l2_buffer buffer = {};
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = i;
+        if (xioctl(fd, VIDIOC_QUERYBUF, &buffer) == -1) {
+            return false;
+        }
+
+        Buffer mapped;
+        mapped.length = buffer.length;
+        mapped.start = mmap(0, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buffer.m.offset);
+        if (mapped.start == MAP_FAILED) {
+            return false;
+        }
+        buffers.push_back(mapped);
+
+        if (xioctl(fd, VIDIOC_QBUF, &buffer) == -1) {
+            return false;
+        }
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    return xioctl(fd, VIDIOC_STREAMON, &type) != -1;
+
+}
+
+bool V4L2Source::grab(double &timestamp) {
+
+    if (fd < 0) {
+        return false;
+    }
+
+    // Hand the lent buffer back before waiting for the next, so the driver is never short of one
+    v4l2_buffer buffer = {};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    if (current >= 0) {
+        buffer.index = current;
+        current = -1;
+        if (xioctl(fd, VIDIOC_QBUF, &buffer) == -1) {
+            return false;
+        }
+    }
+
+    if (xioctl(fd, VIDIOC_DQBUF, &buffer) == -1) {
+        return false;
+    }
+    current = buffer.index;
+
+    // Drivers stamping frames on the monotonic clock give the time the frame was actually taken,
+    // on the same clock as getTickCount
+    if ((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        timestamp = buffer.timestamp.tv_sec + buffer.timestamp.tv_usec * 1e-6;
+    } else {
+        timestamp = now();
+    }
+    return true;
+
+}
+
+bool V4L2Source::retrieveRaw(cv::Mat &frame) {
+
+    if (current < 0) {
+        return false;
+    }
+
+    frame = cv::Mat(size, CV_8UC2, buffers[current].start, stride);
+    return true;
+
+}
+
+bool V4L2Source::retrieve(cv::Mat &frame) {
+
+    cv::Mat raw;
+    if (!retrieveRaw(raw)) {
+        return false;
+    }
+    cv::cvtColor(raw, frame, CV_YUV2BGR_YUYV);
+    return true;
+
+}
+
+void V4L2Source::release() {
+
+    if (fd < 0) {
+        return;
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xioctl(fd, VIDIOC_STREAMOFF, &type);
+    for (size_t i = 0; i < buffers.size(); i++) {
+        munmap(buffers[i].start, buffers[i].length);
+    }
+    buffers.clear();
+    current = -1;
+
+    close(fd);
+    fd = -1;
+
+}
+#endif
+
+//--------------------------------------------------------------------------------------
+// Size of raw frames from a file name like clip.640x480.yuyv, or an empty size if the
+// name isn't one
+//--------------------------------------------------------------------------------------
+static cv::Size rawFrameSize(const std::string &name) {
+
+    const std::string extension = ".yuyv";
+    if (name.size() <= extension.size() || name.compare(name.size() - extension.size(), extension.size(), extension) != 0) {
+        return cv::Size();
+    }
+
+    std::string stem = name.substr(0, name.size() - extension.size());
+    size_t dot = stem.find_last_of('.');
+    int width = 0, height = 0;
+    if (dot == std::string::npos || sscanf(stem.c_str() + dot + 1, "%dx%d", &width, &height) != 2) {
+        return cv::Size();
+    }
+    return cv::Size(width, height);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Open the frame source a name refers to
+//--------------------------------------------------------------------------------------
+FrameSource *openFrameSource(const std::string &name) {
+
+    if (!name.empty() && name.find_first_not_of("0123456789") == std::string::npos) {
+        return new CameraSource(atoi(name.c_str()));
+    }
+
+#ifdef __linux__
+    if (name.compare(0, 10, "/dev/video") == 0) {
+        return new V4L2Source(name);
+    }
+#endif
+
+    cv::Size rawSize = rawFrameSize(name);
+    if (rawSize.area() > 0) {
+        return new RawFileSource(name, rawSize);
+    }
+
+    if (name.find('*') != std::string::npos || name.find('?') != std::string::npos) {
+        return new ImageSequenceSource(name);
+    }
+
+    // Anything that doesn't open as a video is taken to be a directory of images
+    FrameSource *video = new VideoFileSource(name);
+    if (video->isOpened()) {
+        return video;
+    }
+    delete video;
+    return new ImageSequenceSource(name);
+
+}
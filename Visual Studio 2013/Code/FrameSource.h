@@ -0,0 +1,163 @@
+//--------------------------------------------------------------------------------------
+// File: FrameSource.h
+//
+// This file contains the definitions for the sources of frames fed to the tracker
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "OpenCVToolkit.h"
+#include "MappedFile.h"
+
+//--------------------------------------------------------------------------------------
+// A source of frames to track, such as a camera or a recorded clip
+//--------------------------------------------------------------------------------------
+class FrameSource {
+public:
+    virtual ~FrameSource() {};
+
+    virtual bool isOpened() = 0;
+    // Whether frames arrive in real time, and can queue up while the tracker is busy
+    virtual bool isLive() = 0;
+
+    // Wait for the next frame and stamp it with its capture time in seconds, then decode it
+    virtual bool grab(double &timestamp) = 0;
+    virtual bool retrieve(cv::Mat &frame) = 0;
+    bool read(cv::Mat &frame, double &timestamp) { return grab(timestamp) && retrieve(frame); };
+    // Borrow the frame in the layout the camera delivered it, without decoding or copying it.
+    // YUYV frames come back as CV_8UC2 and stay valid until the next grab. Sources that can't
+    // lend their frames decode them as retrieve does.
+    virtual bool retrieveRaw(cv::Mat &frame) { return retrieve(frame); };
+    // Whether retrieveRaw lends YUYV frames, so the tracker can bake their tables up front
+    virtual bool lendsYUYV() { return false; };
+
+    virtual void release() = 0;
+
+    // Clock used to stamp live frames, in seconds
+    static double now();
+};
+
+//--------------------------------------------------------------------------------------
+// Frames from a camera
+//--------------------------------------------------------------------------------------
+class CameraSource : public FrameSource {
+public:
+    // Ask the camera for a resolution, or leave it at its default with an empty size
+    CameraSource(int device = 0, cv::Size resolution = cv::Size());
+
+    bool isOpened() { return capture.isOpened(); };
+    bool isLive() { return true; };
+    bool grab(double &timestamp);
+    bool retrieve(cv::Mat &frame) { return capture.retrieve(frame); };
+    void release() { capture.release(); };
+
+private:
+    cv::VideoCapture capture;
+};
+
+//--------------------------------------------------------------------------------------
+// Frames from a recorded video file, stamped with their position in the recording
+//--------------------------------------------------------------------------------------
+class VideoFileSource : public FrameSource {
+public:
+    VideoFileSource(const std::string &path);
+
+    bool isOpened() { return capture.isOpened(); };
+    bool isLive() { return false; };
+    bool grab(double &timestamp);
+    bool retrieve(cv::Mat &frame) { return capture.retrieve(frame); };
+    void release() { capture.release(); };
+
+private:
+    cv::VideoCapture capture;
+    double frameTime;
+    int frameNumber;
+};
+
+//--------------------------------------------------------------------------------------
+// Frames from a sequence of image files, matched by a wildcard pattern or a directory,
+// played back in name order at a fixed frame rate
+//--------------------------------------------------------------------------------------
+class ImageSequenceSource : public FrameSource {
+public:
+    ImageSequenceSource(const std::string &pattern, double fps = 30.0);
+
+    bool isOpened() { return !files.empty(); };
+    bool isLive() { return false; };
+    bool grab(double &timestamp);
+    bool retrieve(cv::Mat &frame);
+    void release() { files.clear(); };
+
+private:
+    vector<std::string> files;
+    double fps;
+    int next;
+};
+
+//--------------------------------------------------------------------------------------
+// Frames replayed from a file of raw YUYV frames stored back to back, as v4l2-ctl
+// --stream-to records them, standing in for a V4L2 camera. The file is mapped into memory
+// and frames are lent straight out of the mapping.
+//--------------------------------------------------------------------------------------
+class RawFileSource : public FrameSource {
+public:
+    RawFileSource(const std::string &path, cv::Size size, double fps = 30.0);
+
+    bool isOpened() { return frameCount > 0; };
+    bool isLive() { return false; };
+    bool grab(double &timestamp);
+    bool retrieve(cv::Mat &frame);
+    bool retrieveRaw(cv::Mat &frame);
+    bool lendsYUYV() { return true; };
+    void release() { frameCount = 0; };
+
+private:
+    MappedFile file;
+    cv::Size size;
+    double fps;
+    size_t frameCount;
+    size_t next;
+};
+
+#ifdef __linux__
+//--------------------------------------------------------------------------------------
+// Frames from a V4L2 camera in YUYV, captured into buffers mapped from the driver and lent
+// out without conversion
+//--------------------------------------------------------------------------------------
+class V4L2Source : public FrameSource {
+public:
+    // Ask the camera for a resolution, or leave it at its current one with an empty size
+    V4L2Source(const std::string &device = "/dev/video0", cv::Size resolution = cv::Size());
+    ~V4L2Source() { release(); };
+
+    bool isOpened() { return fd >= 0; };
+    bool isLive() { return true; };
+    bool grab(double &timestamp);
+    bool retrieve(cv::Mat &frame);
+    bool retrieveRaw(cv::Mat &frame);
+    bool lendsYUYV() { return true; };
+    void release();
+
+private:
+    struct Buffer {
+        void *start;
+        size_t length;
+    };
+
+    int fd;
+    cv::Size size;
+    size_t stride;
+    vector<Buffer> buffers;
+    // Buffer lent out since the last grab, handed back to the driver on the next one
+    int current;
+
+    bool start(const std::string &device, cv::Size resolution);
+
+    V4L2Source(const V4L2Source&);
+    V4L2Source &operator=(const V4L2Source&);
+};
+#endif
+
+// Open a camera from its device number or V4L2 device path, raw YUYV frames from a file named like
+// clip.640x480.yuyv, an image sequence from a pattern or directory, or else a video file
+extern FrameSource *openFrameSource(const std::string &name);
@@ -0,0 +1,178 @@
+//--------------------------------------------------------------------------------------
+// File: FrameViewer.cpp
+//
+// This file contains the implementations for showing tracked frames in a debug window
+// from a thread of its own
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+
+#include "FrameViewer.h"
+
+// Longest the viewer waits for a frame before letting the window handle its events
+static const int idleWait = 50; //ms
+
+static double seconds() {
+
+    return cv::getTickCount() / cv::getTickFrequency();
+
+}
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+FrameViewer::FrameViewer(const std::string &windowName, int downsample, double maxFps, size_t queueLength)
+    : windowName(windowName), downsample(std::max(downsample, 1)), minInterval(maxFps > 0.0 ? 1.0 / maxFps : 0.0),
+    queueLength(std::max(queueLength, (size_t)1)), running(false), droppedFrames(0), lastSubmit(0.0) {
+
+}
+
+//--------------------------------------------------------------------------------------
+// Start and stop the viewer thread, which owns the window
+//--------------------------------------------------------------------------------------
+void FrameViewer::start() {
+
+    if (running) {
+        return;
+    }
+
+    running = true;
+    thread = std::thread(&FrameViewer::RenderLoop, this);
+
+}
+
+void FrameViewer::stop() {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    ready.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    queue.clear();
+
+}
+
+//--------------------------------------------------------------------------------------
+// Shrink a frame into a queued frame of the viewer's own, so the caller's buffer can be
+// reused as soon as this returns
+//--------------------------------------------------------------------------------------
+bool FrameViewer::submit(const cv::Mat &frame, const vector<ViewerOverlay> &overlays, bool mirror) {
+
+    if (!running || frame.empty()) {
+        return false;
+    }
+
+    // Frames faster than the display rate would only be replaced before they were shown
+    double now = seconds();
+    if (now - lastSubmit < minInterval) {
+        return false;
+    }
+    lastSubmit = now;
+
+    // Reuse a spare frame, or else the oldest waiting one if the viewer has fallen behind
+    ViewerFrame entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!spare.empty()) {
+            std::swap(entry, spare.back());
+            spare.pop_back();
+        } else if (queue.size() >= queueLength) {
+            std::swap(entry, queue.front());
+            queue.pop_front();
+            droppedFrames++;
+        }
+    }
+
+    // Nearest neighbour is plenty for a debug view, and the cheapest to run on the tracking thread
+    cv::Size size(std::max(frame.cols / downsample, 2), std::max(frame.rows / downsample, 1));
+    if (frame.type() == CV_8UC2) {
+        // Shrink YUYV a pixel pair at a time, so each pair keeps its chroma, then decode what is left
+        const cv::Mat pairs(frame.rows, frame.cols / 2, CV_8UC4, frame.data, frame.step);
+        cv::resize(pairs, shrunkPairs, cv::Size(size.width / 2, size.height), 0, 0, cv::INTER_NEAREST);
+        const cv::Mat shrunk(shrunkPairs.rows, shrunkPairs.cols * 2, CV_8UC2, shrunkPairs.data, shrunkPairs.step);
+        cv::cvtColor(shrunk, entry.image, CV_YUV2BGR_YUYV);
+    } else {
+        cv::resize(frame, entry.image, size, 0, 0, cv::INTER_NEAREST);
+    }
+    if (mirror) {
+        cv::flip(entry.image, entry.image, 1);
+    }
+    entry.overlays.assign(overlays.begin(), overlays.end());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (queue.size() >= queueLength) {
+            spare.push_back(ViewerFrame());
+            std::swap(spare.back(), queue.front());
+            queue.pop_front();
+            droppedFrames++;
+        }
+        queue.push_back(ViewerFrame());
+        std::swap(queue.back(), entry);
+    }
+    ready.notify_one();
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Viewer thread, showing queued frames no faster than the display rate
+//--------------------------------------------------------------------------------------
+void FrameViewer::RenderLoop() {
+
+    ViewerFrame frame;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait_for(lock, std::chrono::milliseconds(idleWait), [this] { return !queue.empty() || !running; });
+            if (!running) {
+                break;
+            }
+            if (queue.empty()) {
+                lock.unlock();
+                cv::waitKey(1);
+                continue;
+            }
+            std::swap(frame, queue.front());
+            queue.pop_front();
+        }
+
+        double start = seconds();
+        render(frame);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            spare.push_back(ViewerFrame());
+            std::swap(spare.back(), frame);
+        }
+
+        // Let the window handle its events for the rest of the frame's display time
+        int wait = (int)((minInterval - (seconds() - start)) * 1000.0);
+        cv::waitKey(std::max(wait, 1));
+    }
+
+    cv::destroyWindow(windowName);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Draw a frame's overlays, scaled down with it, and show it
+//--------------------------------------------------------------------------------------
+void FrameViewer::render(ViewerFrame &frame) {
+
+    // Text stays legible however far the frame was shrunk
+    const double textScale = std::max(1.0 / downsample, 0.7);
+    const int lineHeight = (int)(20 * textScale);
+    for (size_t i = 0; i < frame.overlays.size(); i++) {
+        const ViewerOverlay &overlay = frame.overlays[i];
+        cv::Point marker(overlay.marker.x / downsample, overlay.marker.y / downsample);
+        cv::putText(frame.image, overlay.text, cv::Point(5, lineHeight * (int)(i + 1)), 1, textScale, cv::Scalar(0, 255, 255), 1);
+        cv::putText(frame.image, "+", marker, 1, 3 * textScale, overlay.colour, 2);
+    }
+
+    cv::imshow(windowName, frame.image);
+
+}
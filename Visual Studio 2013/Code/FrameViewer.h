@@ -0,0 +1,93 @@
+//--------------------------------------------------------------------------------------
+// File: FrameViewer.h
+//
+// This file contains the definitions for showing tracked frames in a debug window from
+// a thread of its own
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "OpenCVToolkit.h"
+
+//--------------------------------------------------------------------------------------
+// Text and a marker drawn over a viewed frame, in the coordinates of the full frame
+//--------------------------------------------------------------------------------------
+struct ViewerOverlay {
+    std::string text;
+    cv::Point marker;
+    cv::Scalar colour;
+};
+
+//--------------------------------------------------------------------------------------
+// Shows frames handed over by the tracker in a window, drawing their overlays and calling
+// imshow on its own thread. Frames are shrunk as they are handed over and queued up to a
+// fixed length, dropping the oldest when the viewer falls behind, so the tracker never
+// waits on the window. Frames arriving faster than the display rate are skipped before
+// they are copied.
+//--------------------------------------------------------------------------------------
+class FrameViewer {
+public:
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    // Shrink frames by an integer factor, and show at most maxFps of them a second
+    FrameViewer(const std::string &windowName = "Tracker", int downsample = 2, double maxFps = 15.0, size_t queueLength = 2);
+    ~FrameViewer() { stop(); };
+
+    void start();
+    void stop();
+    bool isRunning() const { return running; };
+
+    // Hand a BGR or YUYV frame over to be shown, from any one thread, mirroring the shown copy when
+    // the frame hasn't been. Overlays are in the coordinates shown. Returns whether it was queued.
+    bool submit(const cv::Mat &frame, const vector<ViewerOverlay> &overlays, bool mirror = false);
+
+    // Frames pushed out of the queue before they could be shown
+    unsigned long getDroppedFrames() const { return droppedFrames; };
+
+private:
+    //--------------------------------------------------------------------------------------
+    // Variables
+    //--------------------------------------------------------------------------------------
+
+    struct ViewerFrame {
+        cv::Mat image;
+        vector<ViewerOverlay> overlays;
+    };
+
+    std::string windowName;
+    int downsample;
+    double minInterval;     // s
+    size_t queueLength;
+
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<unsigned long> droppedFrames;
+    double lastSubmit;
+
+    // Frames waiting to be shown, oldest first, and spare ones whose buffers are reused
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<ViewerFrame> queue;
+    vector<ViewerFrame> spare;
+
+    // YUYV pixel pairs shrunk before they are decoded
+    cv::Mat shrunkPairs;
+
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    void RenderLoop();
+    void render(ViewerFrame &frame);
+
+    FrameViewer(const FrameViewer&);
+    FrameViewer &operator=(const FrameViewer&);
+};
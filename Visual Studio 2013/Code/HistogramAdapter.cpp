@@ -0,0 +1,364 @@
+//--------------------------------------------------------------------------------------
+// File: HistogramAdapter.cpp
+//
+// This file contains the implementations for adapting the targets' histograms to the
+// lighting while tracking
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+
+#include "HistogramAdapter.h"
+
+// Shortest time between two rounds of blending and patching tables on the adapter thread
+static const int blendInterval = 100; //ms
+// Part of the target's radius sampled, keeping clear of the background around its edge
+static const float sampleRadius = 0.7f;
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+HistogramAdapter::HistogramAdapter(double decay, double budgetMs, int maxSamples, float minRadius, int minStableFrames)
+    : decay(std::max(0.0, std::min(decay, 1.0))), budgetMs(budgetMs), maxSamples(std::max(maxSamples, 1)), minRadius(minRadius),
+    minStableFrames(minStableFrames), nextTarget(0), running(false), foldedFrames(0), maxFoldMs(0.0) {
+
+}
+
+//--------------------------------------------------------------------------------------
+// Group a table's cells by the histogram bin they fall in
+//--------------------------------------------------------------------------------------
+static void indexCells(const BackProjectLUT &lut, int hsvCode, int hbins, int sbins, vector<int> &start, vector<int> &cells) {
+
+    vector<int> cellBins;
+    BackProjectLUT::binCells(lut.getBits(), hsvCode, lut.isYUYV(), hbins, sbins, cellBins);
+
+    const int bins = hbins * sbins;
+    start.assign(bins + 1, 0);
+    for (size_t cell = 0; cell < cellBins.size(); cell++) {
+        if (cellBins[cell] >= 0) {
+            start[cellBins[cell] + 1]++;
+        }
+    }
+    for (int bin = 0; bin < bins; bin++) {
+        start[bin + 1] += start[bin];
+    }
+
+    vector<int> next(start.begin(), start.end() - 1);
+    cells.resize(start[bins]);
+    for (size_t cell = 0; cell < cellBins.size(); cell++) {
+        if (cellBins[cell] >= 0) {
+            cells[next[cellBins[cell]]++] = (int)cell;
+        }
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Start and stop adapting. Adapted histograms and tables stay with the targets once stopped.
+//--------------------------------------------------------------------------------------
+void HistogramAdapter::start(const TargetSet &targets) {
+
+    stop();
+
+    this->targets.assign(targets.size(), Target());
+    for (size_t i = 0; i < targets.size(); i++) {
+        Target &target = this->targets[i];
+        const cv::MatND &hist = targets.hists[i];
+        target.hsvCode = targets.hsvCodes[i];
+        target.total = hist.data ? cv::sum(hist)[0] : 0.0;
+        target.frameCount = 0;
+        target.pendingFrames = 0;
+        target.appliedVersion = 0;
+
+        std::shared_ptr<Adapted> adapted = std::make_shared<Adapted>();
+        adapted->hist = hist;
+        adapted->lut = targets.luts[i];
+        adapted->yuyvLut = targets.yuyvLuts[i];
+        adapted->version = 0;
+        target.published = adapted;
+
+        // Targets tracking nothing stay that way
+        if (target.total <= 0.0) {
+            continue;
+        }
+        CV_Assert(hist.type() == CV_32F && hist.dims == 2 && hist.isContinuous());
+        const int hbins = hist.size[0];
+        const int sbins = hist.size[1];
+        target.hist = hist.clone();
+        target.frameHist = cv::Mat::zeros(cv::Size(sbins, hbins), CV_32F);
+        target.pending = cv::Mat::zeros(cv::Size(sbins, hbins), CV_32F);
+
+        target.binValues.resize(hbins * sbins);
+        const float *values = target.hist.ptr<float>();
+        for (int bin = 0; bin < hbins * sbins; bin++) {
+            target.binValues[bin] = cv::saturate_cast<uchar>(values[bin]);
+        }
+        if (!adapted->lut.empty()) {
+            indexCells(adapted->lut, target.hsvCode, hbins, sbins, target.lutCells.start, target.lutCells.cells);
+        }
+        if (!adapted->yuyvLut.empty()) {
+            indexCells(adapted->yuyvLut, target.hsvCode, hbins, sbins, target.yuyvCells.start, target.yuyvCells.cells);
+        }
+    }
+
+    samples.create(1, maxSamples * 2, CV_8UC3);
+    decoded.create(1, maxSamples * 2, CV_8UC3);
+    hsv.create(1, maxSamples * 2, CV_8UC3);
+    nextTarget = 0;
+    running = true;
+    thread = std::thread(&HistogramAdapter::AdaptLoop, this);
+
+}
+
+void HistogramAdapter::stop() {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    ready.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Sample a grid over the inner part of a target's disc into the HSV buffer, returning the
+// number of pixels sampled. YUYV frames are sampled a pixel pair at a time.
+//--------------------------------------------------------------------------------------
+int HistogramAdapter::sample(const cv::Mat &frame, const TrackResult &result, int hsvCode) {
+
+    const bool yuyv = frame.type() == CV_8UC2;
+    const float radius = result.radius * sampleRadius;
+    const int step = std::max(1, cvCeil(std::sqrt(CV_PI * radius * radius / maxSamples)));
+    const int r = (int)radius;
+    const int cx = cvRound(result.centroid.x);
+    const int cy = cvRound(result.centroid.y);
+
+    int count = 0;
+    uchar *dst = samples.ptr<uchar>();
+    for (int dy = -r; dy <= r && count < maxSamples; dy += step) {
+        int y = cy + dy;
+        if (y < 0 || y >= frame.rows) {
+            continue;
+        }
+        const uchar *row = frame.ptr<uchar>(y);
+        for (int dx = -r; dx <= r && count < maxSamples; dx += step) {
+            int x = cx + dx;
+            if (dx * dx + dy * dy > r * r || x < 0 || x >= frame.cols) {
+                continue;
+            }
+            if (yuyv) {
+                const uchar *pair = row + (x & ~1) * 2;
+                if ((x & ~1) + 1 >= frame.cols) {
+                    continue;
+                }
+                std::copy(pair, pair + 4, dst);
+                dst += 4;
+            } else {
+                std::copy(row + x * 3, row + x * 3 + 3, dst);
+                dst += 3;
+            }
+            count++;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    // Convert only the samples, into buffers sized for the most there can be
+    cv::Mat pixels;
+    if (yuyv) {
+        const cv::Mat pairs(1, count * 2, CV_8UC2, samples.data);
+        pixels = decoded.colRange(0, count * 2);
+        cv::cvtColor(pairs, pixels, CV_YUV2BGR_YUYV);
+        count *= 2;
+    } else {
+        pixels = samples.colRange(0, count);
+    }
+    cv::Mat converted = hsv.colRange(0, count);
+    cv::cvtColor(pixels, converted, hsvCode);
+    return count;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Sample the confidently tracked targets, starting from the one the last frame ran out
+// of time on, and hand their histograms to the adapter thread if it isn't busy with them.
+// A target found once in the frame may be something else of its colour, and folding that
+// in would teach the histogram to find it again.
+//--------------------------------------------------------------------------------------
+void HistogramAdapter::fold(const cv::Mat &frame, const vector<TrackResult> &results, const vector<TrackWindow> &windows) {
+
+    if (!running || frame.empty()) {
+        return;
+    }
+
+    const int64 start = cv::getTickCount();
+    const double budget = budgetMs * 1e-3 * cv::getTickFrequency();
+    const size_t count = std::min(targets.size(), std::min(results.size(), windows.size()));
+    const size_t first = count ? nextTarget % count : 0;
+    nextTarget = first + 1;
+    for (size_t k = 0; k < count; k++) {
+        size_t i = (first + k) % count;
+        if (cv::getTickCount() - start > budget) {
+            nextTarget = i;
+            break;
+        }
+
+        Target &target = targets[i];
+        if (target.total <= 0.0 || !windows[i].locked || windows[i].stableFrames < minStableFrames || results[i].radius < minRadius) {
+            continue;
+        }
+        int pixels = sample(frame, results[i], target.hsvCode);
+        if (pixels == 0) {
+            continue;
+        }
+
+        const cv::Mat converted = hsv.colRange(0, pixels);
+        int bins[] = { target.frameHist.size[0], target.frameHist.size[1] };
+        cv::calcHist(&converted, 1, hsv_channels, cv::Mat(), sampleHist, dim, bins, ranges, true, false);
+        cv::scaleAdd(sampleHist, 1.0 / pixels, target.frameHist, target.frameHist);
+        target.frameCount++;
+    }
+
+    // Never wait on the adapter thread; samples it can't take now go with the next frame's
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        for (size_t i = 0; i < targets.size(); i++) {
+            Target &target = targets[i];
+            if (target.frameCount == 0) {
+                continue;
+            }
+            cv::add(target.pending, target.frameHist, target.pending);
+            target.pendingFrames += target.frameCount;
+            target.frameHist.setTo(cv::Scalar(0));
+            target.frameCount = 0;
+        }
+        lock.unlock();
+    }
+
+    double ms = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+    if (ms > maxFoldMs) {
+        maxFoldMs = ms;
+    }
+    foldedFrames++;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Swap in whatever the adapter thread published since the last call
+//--------------------------------------------------------------------------------------
+bool HistogramAdapter::apply(TargetSet &targets) {
+
+    bool changed = false;
+    for (size_t i = 0; i < this->targets.size() && i < targets.size(); i++) {
+        Target &target = this->targets[i];
+        std::shared_ptr<const Adapted> latest = std::atomic_load(&target.published);
+        if (latest->version == target.appliedVersion) {
+            continue;
+        }
+        targets.hists[i] = latest->hist;
+        if (!latest->lut.empty()) {
+            targets.luts[i] = latest->lut;
+        }
+        if (!latest->yuyvLut.empty()) {
+            targets.yuyvLuts[i] = latest->yuyvLut;
+        }
+        target.appliedVersion = latest->version;
+        changed = true;
+    }
+    return changed;
+
+}
+
+//--------------------------------------------------------------------------------------
+// A copy of a table with the cells of the changed bins rewritten
+//--------------------------------------------------------------------------------------
+static BackProjectLUT patchTable(const BackProjectLUT &lut, const vector<int> &start, const vector<int> &cells,
+    const vector<int> &changed, const vector<uchar> &binValues) {
+
+    if (lut.empty() || changed.empty()) {
+        return lut;
+    }
+
+    std::shared_ptr<vector<uchar>> table = std::make_shared<vector<uchar>>(lut.data(), lut.data() + lut.size());
+    for (size_t i = 0; i < changed.size(); i++) {
+        int bin = changed[i];
+        for (int cell = start[bin]; cell < start[bin + 1]; cell++) {
+            (*table)[cells[cell]] = binValues[bin];
+        }
+    }
+
+    BackProjectLUT patched;
+    patched.adopt(&(*table)[0], lut.getBits(), table, lut.isYUYV());
+    return patched;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Decay a target's histogram by the frames sampled, blend their samples in at the same
+// total, then publish it with its tables patched where their values changed
+//--------------------------------------------------------------------------------------
+void HistogramAdapter::blend(Target &target, const cv::MatND &pending, int frames) {
+
+    double keep = std::pow(1.0 - decay, frames);
+    cv::addWeighted(target.hist, keep, pending, (1.0 - keep) * target.total / frames, 0.0, target.hist);
+
+    vector<int> changed;
+    const float *values = target.hist.ptr<float>();
+    for (size_t bin = 0; bin < target.binValues.size(); bin++) {
+        uchar value = cv::saturate_cast<uchar>(values[bin]);
+        if (value != target.binValues[bin]) {
+            target.binValues[bin] = value;
+            changed.push_back((int)bin);
+        }
+    }
+    // Back projections only see the histogram saturated to 8 bits, so are unchanged
+    if (changed.empty()) {
+        return;
+    }
+
+    std::shared_ptr<const Adapted> current = std::atomic_load(&target.published);
+    std::shared_ptr<Adapted> adapted = std::make_shared<Adapted>();
+    adapted->hist = target.hist.clone();
+    adapted->lut = patchTable(current->lut, target.lutCells.start, target.lutCells.cells, changed, target.binValues);
+    adapted->yuyvLut = patchTable(current->yuyvLut, target.yuyvCells.start, target.yuyvCells.cells, changed, target.binValues);
+    adapted->version = current->version + 1;
+    std::atomic_store(&target.published, std::shared_ptr<const Adapted>(adapted));
+
+}
+
+//--------------------------------------------------------------------------------------
+// Adapter thread, blending in the samples handed over no more often than the blend interval
+//--------------------------------------------------------------------------------------
+void HistogramAdapter::AdaptLoop() {
+
+    vector<cv::MatND> pending(targets.size());
+    vector<int> frames(targets.size());
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait_for(lock, std::chrono::milliseconds(blendInterval), [this] { return !running; });
+            if (!running) {
+                break;
+            }
+            for (size_t i = 0; i < targets.size(); i++) {
+                Target &target = targets[i];
+                frames[i] = target.pendingFrames;
+                if (frames[i] > 0) {
+                    target.pending.copyTo(pending[i]);
+                    target.pending.setTo(cv::Scalar(0));
+                    target.pendingFrames = 0;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < targets.size(); i++) {
+            if (frames[i] > 0) {
+                blend(targets[i], pending[i], frames[i]);
+            }
+        }
+    }
+
+}
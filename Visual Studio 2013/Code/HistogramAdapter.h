@@ -0,0 +1,130 @@
+//--------------------------------------------------------------------------------------
+// File: HistogramAdapter.h
+//
+// This file contains the definitions for adapting the targets' histograms to the lighting
+// while tracking
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "BackProjectLUT.h"
+#include "OpenCVToolkit.h"
+#include "TargetSet.h"
+
+//--------------------------------------------------------------------------------------
+// Follows lighting drift by folding the colours of confidently tracked targets into
+// exponentially decayed copies of their histograms. The tracking thread only samples a
+// bounded number of pixels per frame, within a time budget, and hands their histograms
+// over without waiting. A thread of its own blends them in and patches the cells of the
+// lookup tables whose bins changed, then publishes the histograms and tables, which the
+// tracking thread swaps in at the start of a frame.
+//--------------------------------------------------------------------------------------
+class HistogramAdapter {
+public:
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    // Each frame's colours weigh decay in the histogram, and sampling them takes at most budgetMs.
+    // Targets are only trusted to be the target once held in a search window with a steady area
+    // for minStableFrames frames, and while no smaller than minRadius.
+    HistogramAdapter(double decay = 0.02, double budgetMs = 0.5, int maxSamples = 256, float minRadius = 6.f, int minStableFrames = 5);
+    ~HistogramAdapter() { stop(); };
+
+    // Adapt the targets' histograms, and the lookup tables they have baked, from here on
+    void start(const TargetSet &targets);
+    void stop();
+    bool isRunning() const { return running; };
+
+    // Sample the targets found in a frame, BGR or YUYV, into their histograms. Without search
+    // windows, as when tracking the whole frame, no target is trusted.
+    void fold(const cv::Mat &frame, const vector<TrackResult> &results, const vector<TrackWindow> &windows);
+    // Swap the newest adapted histograms and tables into the targets. Returns whether any changed.
+    bool apply(TargetSet &targets);
+
+    // Frames folded in, and the longest a fold took
+    unsigned long getFoldedFrames() const { return foldedFrames; };
+    double getMaxFoldMs() const { return maxFoldMs; };
+
+private:
+    //--------------------------------------------------------------------------------------
+    // Variables
+    //--------------------------------------------------------------------------------------
+
+    // Histogram and tables published together, never changed once published
+    struct Adapted {
+        cv::MatND hist;
+        BackProjectLUT lut;
+        BackProjectLUT yuyvLut;
+        unsigned long version;
+    };
+
+    // Table cells grouped by the histogram bin they fall in
+    struct CellIndex {
+        vector<int> start;      // First cell of each bin, and one past the last bin's
+        vector<int> cells;
+    };
+
+    struct Target {
+        int hsvCode;
+        double total;                   // Sum the histogram is kept at, so back projections keep their scale
+
+        // Tracking thread only
+        cv::MatND frameHist;            // Sample histograms not handed over yet, each normalised
+        int frameCount;
+        unsigned long appliedVersion;
+
+        // Handed over under the mutex
+        cv::MatND pending;
+        int pendingFrames;
+
+        // Adapter thread only
+        cv::MatND hist;
+        vector<uchar> binValues;        // Table value of each bin, as last baked
+        CellIndex lutCells;
+        CellIndex yuyvCells;
+
+        // Latest published, read and written with the atomic shared_ptr functions
+        std::shared_ptr<const Adapted> published;
+    };
+
+    double decay;
+    double budgetMs;
+    int maxSamples;
+    float minRadius;
+    int minStableFrames;
+
+    vector<Target> targets;
+    size_t nextTarget;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<unsigned long> foldedFrames;
+    std::atomic<double> maxFoldMs;
+
+    // Guards the samples handed over, and wakes the adapter thread to stop
+    std::mutex mutex;
+    std::condition_variable ready;
+
+    // Sampled pixels, reused every frame
+    cv::Mat samples;
+    cv::Mat decoded;
+    cv::Mat hsv;
+    cv::MatND sampleHist;
+
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    void AdaptLoop();
+    void blend(Target &target, const cv::MatND &pending, int frames);
+    int sample(const cv::Mat &frame, const TrackResult &result, int hsvCode);
+
+    HistogramAdapter(const HistogramAdapter&);
+    HistogramAdapter &operator=(const HistogramAdapter&);
+};
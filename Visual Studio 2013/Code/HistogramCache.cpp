@@ -0,0 +1,221 @@
+//--------------------------------------------------------------------------------------
+// File: HistogramCache.cpp
+//
+// This file contains the implementations for the binary cache of trained histograms and
+// their back projection lookup tables
+//--------------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+#include "HistogramCache.h"
+#include "MappedFile.h"
+#include "TargetSet.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+//--------------------------------------------------------------------------------------
+// File layout: the header, then the histogram's floats, then the BGR and YUYV lookup
+// tables, each starting on a 64 byte boundary with zero padding between them. The checksum covers
+// the header, taken with the checksum zeroed, and everything after it.
+//--------------------------------------------------------------------------------------
+static const char cacheMagic[8] = { 'B', 'B', 'H', 'I', 'S', 'T', 'C', 'C' };
+static const uint32_t cacheVersion = 3;
+static const size_t cacheAlignment = 64;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t hsvCode;
+    int64_t sourceSize;         // Size and modification time of the YAML the cache was built from
+    int64_t sourceTime;
+    int32_t histRows;
+    int32_t histCols;
+    int32_t histType;
+    int32_t lutBits;            // 0 when there are no tables, both tables share it
+    uint64_t histOffset;
+    uint64_t lutOffset;
+    uint64_t yuyvLutOffset;
+    uint64_t fileSize;
+    uint64_t checksum;
+};
+static_assert(sizeof(CacheHeader) % sizeof(uint64_t) == 0, "the checksum reads the header as whole words");
+
+static size_t alignUp(size_t offset) {
+
+    return (offset + cacheAlignment - 1) / cacheAlignment * cacheAlignment;
+
+}
+
+// FNV-1a over 64 bit words, continuing from hash. The header and everything after it are
+// each a whole number of words.
+static uint64_t checksum(const uchar *data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+
+    const uint64_t *words = (const uint64_t*)data;
+    for (size_t i = 0; i < size / sizeof(uint64_t); i++) {
+        hash = (hash ^ words[i]) * 1099511628211ULL;
+    }
+    return hash;
+
+}
+
+// Checksum of a header and the payload after it. Header fields in range but corrupted would
+// otherwise give a histogram or table of the wrong shape.
+static uint64_t checksum(const CacheHeader &header, const uchar *payload, size_t size) {
+
+    CacheHeader unsummed = header;
+    unsummed.checksum = 0;
+    return checksum(payload, size, checksum((const uchar*)&unsummed, sizeof(unsummed)));
+
+}
+
+// Size and modification time of a file, or false if it doesn't exist
+static bool fileStamp(const std::string &path, int64_t &size, int64_t &time) {
+
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    size = (int64_t)info.st_size;
+    time = (int64_t)info.st_mtime;
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Map a cache file and check it against what it is meant to hold. Returns the mapping, or
+// nothing if the cache can't be used.
+//--------------------------------------------------------------------------------------
+static std::shared_ptr<MappedFile> mapCache(const std::string &cachePath, const std::string &sourcePath, int lutBits) {
+
+    std::shared_ptr<MappedFile> mapped = std::make_shared<MappedFile>();
+    if (!mapped->open(cachePath) || mapped->size < sizeof(CacheHeader)) {
+        return nullptr;
+    }
+
+    const CacheHeader &header = *(const CacheHeader*)mapped->data;
+    if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion || header.fileSize != mapped->size) {
+        return nullptr;
+    }
+    if (lutBits && header.lutBits != lutBits) {
+        return nullptr;
+    }
+
+    // A kiosk may ship the cache without the YAML, otherwise the YAML must not have changed
+    int64_t sourceSize, sourceTime;
+    if (fileStamp(sourcePath, sourceSize, sourceTime) && (sourceSize != header.sourceSize || sourceTime != header.sourceTime)) {
+        return nullptr;
+    }
+
+    const size_t histBytes = (size_t)header.histRows * header.histCols * sizeof(float);
+    const size_t lutBytes = header.lutBits ? (size_t)1 << (3 * header.lutBits) : 0;
+    if (header.histType != CV_32F || header.histRows <= 0 || header.histCols <= 0 || header.histOffset < sizeof(CacheHeader)
+        || header.histOffset + histBytes > mapped->size || (header.lutBits && (header.lutOffset + lutBytes > mapped->size
+        || header.yuyvLutOffset + lutBytes > mapped->size))) {
+        return nullptr;
+    }
+    if (checksum(header, mapped->data + sizeof(CacheHeader), mapped->size - sizeof(CacheHeader)) != header.checksum) {
+        return nullptr;
+    }
+    return mapped;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Write a cache file. It is written beside the cache and renamed over it, so a reboot
+// part way through leaves the old cache or none, never half of one.
+//--------------------------------------------------------------------------------------
+static bool writeCache(const std::string &cachePath, const std::string &sourcePath, const cv::Mat &hist, int hsvCode, const BackProjectLUT &lut,
+    const BackProjectLUT &yuyvLut) {
+
+    CacheHeader header = CacheHeader();
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.hsvCode = hsvCode;
+    fileStamp(sourcePath, header.sourceSize, header.sourceTime);
+    header.histRows = hist.rows;
+    header.histCols = hist.cols;
+    header.histType = hist.type();
+    header.lutBits = lut.empty() ? 0 : lut.getBits();
+
+    const size_t histBytes = hist.total() * hist.elemSize();
+    header.histOffset = alignUp(sizeof(CacheHeader));
+    header.lutOffset = alignUp(header.histOffset + histBytes);
+    header.yuyvLutOffset = alignUp(header.lutOffset + lut.size());
+    header.fileSize = alignUp(header.yuyvLutOffset + yuyvLut.size());
+
+    vector<uchar> payload((size_t)header.fileSize - sizeof(CacheHeader), 0);
+    cv::Mat histCopy(hist.rows, hist.cols, hist.type(), &payload[header.histOffset - sizeof(CacheHeader)]);
+    hist.copyTo(histCopy);
+    if (!lut.empty()) {
+        std::copy(lut.data(), lut.data() + lut.size(), payload.begin() + (header.lutOffset - sizeof(CacheHeader)));
+        std::copy(yuyvLut.data(), yuyvLut.data() + yuyvLut.size(), payload.begin() + (header.yuyvLutOffset - sizeof(CacheHeader)));
+    }
+    header.checksum = checksum(header, &payload[0], payload.size());
+
+    const std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)&payload[0], payload.size());
+        if (!out) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    // Replace the old cache in one step. POSIX rename already does, Windows' doesn't replace.
+#ifdef _WIN32
+    return MoveFileExA(tempPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+#endif
+
+}
+
+//--------------------------------------------------------------------------------------
+// Load from the cache, or rebuild it
+//--------------------------------------------------------------------------------------
+bool loadCachedHistogram(const std::string &path, int lutBits, cv::MatND &hist, int &hsvCode, BackProjectLUT &lut, BackProjectLUT &yuyvLut) {
+
+    const std::string cachePath = path + ".cache";
+
+    std::shared_ptr<MappedFile> mapped = mapCache(cachePath, path, lutBits);
+    if (mapped) {
+        // The histogram is small and copied out, the tables are used where they were mapped
+        const CacheHeader &header = *(const CacheHeader*)mapped->data;
+        cv::Mat(header.histRows, header.histCols, header.histType, (void*)(mapped->data + header.histOffset)).copyTo(hist);
+        hsvCode = header.hsvCode;
+        if (lutBits) {
+            lut.adopt(mapped->data + header.lutOffset, header.lutBits, mapped);
+            yuyvLut.adopt(mapped->data + header.yuyvLutOffset, header.lutBits, mapped, true);
+        } else {
+            lut.release();
+            yuyvLut.release();
+        }
+        return true;
+    }
+
+    if (!loadHistogram(path, hist, hsvCode)) {
+        return false;
+    }
+    if (lutBits) {
+        lut.build(hist, lutBits, hsvCode);
+        yuyvLut.buildYUYV(hist, lutBits, hsvCode);
+    } else {
+        lut.release();
+        yuyvLut.release();
+    }
+    if (!writeCache(cachePath, path, hist, hsvCode, lut, yuyvLut)) {
+        std::cout << "unable to write histogram cache " << cachePath << std::endl;
+    }
+    return true;
+
+}
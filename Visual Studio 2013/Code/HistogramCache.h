@@ -0,0 +1,15 @@
+//--------------------------------------------------------------------------------------
+// File: HistogramCache.h
+//
+// This file contains the definitions for the binary cache of trained histograms and their
+// back projection lookup tables, which is memory mapped at startup instead of parsed
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "BackProjectLUT.h"
+
+// Load a histogram and its BGR and YUYV lookup tables from the cache file beside it, path +
+// ".cache". The cache is rebuilt from the YAML when it is missing, out of date with the YAML,
+// baked at a different bit depth or fails its checksum. lutBits 0 loads the histogram only.
+extern bool loadCachedHistogram(const std::string &path, int lutBits, cv::MatND &hist, int &hsvCode, BackProjectLUT &lut, BackProjectLUT &yuyvLut);
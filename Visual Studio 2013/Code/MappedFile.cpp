@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------------------------
+// File: MappedFile.cpp
+//
+// This file contains the implementations for read only files mapped into memory
+//--------------------------------------------------------------------------------------
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//--------------------------------------------------------------------------------------
+// Map the whole of a file. Empty files can't be mapped.
+//--------------------------------------------------------------------------------------
+bool MappedFile::open(const std::string &path) {
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    file = handle;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0) {
+        return false;
+    }
+    mapping = CreateFileMappingA(handle, 0, PAGE_READONLY, 0, 0, 0);
+    if (!mapping) {
+        return false;
+    }
+    data = (const uchar*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void *view = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    data = (const uchar*)view;
+    size = (size_t)info.st_size;
+#endif
+    return data != 0;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Unmap and close the file
+//--------------------------------------------------------------------------------------
+MappedFile::~MappedFile() {
+
+#ifdef _WIN32
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file) {
+        CloseHandle(file);
+    }
+#else
+    if (data) {
+        munmap((void*)data, size);
+    }
+#endif
+
+}
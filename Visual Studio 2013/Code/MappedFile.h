@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// File: MappedFile.h
+//
+// This file contains the definitions for read only files mapped into memory
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+
+#include <opencv2\core\core.hpp>
+
+//--------------------------------------------------------------------------------------
+// A read only view of a whole file, mapped into memory until it is destroyed. Pages are
+// only read in from disk as they are touched.
+//--------------------------------------------------------------------------------------
+class MappedFile {
+public:
+    MappedFile() : data(0), size(0), file(0), mapping(0) {};
+    ~MappedFile();
+
+    bool open(const std::string &path);
+
+    const uchar *data;
+    size_t size;
+
+private:
+    // Windows file and mapping handles
+    void *file;
+    void *mapping;
+
+    MappedFile(const MappedFile&);
+    MappedFile &operator=(const MappedFile&);
+};
@@ -0,0 +1,189 @@
+//--------------------------------------------------------------------------------------
+// File: Morphology.cpp
+//
+// This file contains the implementations for the fused 3x3 morphology used to clean up
+// back projections and masks
+//--------------------------------------------------------------------------------------
+
+#include "Morphology.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MORPHOLOGY_SSE2 1
+#endif
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || defined(__AVX2__)
+#include <immintrin.h>
+#define MORPHOLOGY_AVX2 1
+#endif
+
+// Instruction sets the kernels can use on this machine
+static const bool haveSSE2 = cv::checkHardwareSupport(CV_CPU_SSE2);
+static const bool haveAVX2 = cv::checkHardwareSupport(CV_CPU_AVX2);
+
+//--------------------------------------------------------------------------------------
+// Element-wise min and max, at each vector width
+//--------------------------------------------------------------------------------------
+struct MinOp {
+    static uchar apply(uchar a, uchar b) { return std::min(a, b); }
+#ifdef MORPHOLOGY_SSE2
+    static __m128i apply(__m128i a, __m128i b) { return _mm_min_epu8(a, b); }
+#endif
+#ifdef MORPHOLOGY_AVX2
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_min_epu8(a, b); }
+#endif
+};
+
+struct MaxOp {
+    static uchar apply(uchar a, uchar b) { return std::max(a, b); }
+#ifdef MORPHOLOGY_SSE2
+    static __m128i apply(__m128i a, __m128i b) { return _mm_max_epu8(a, b); }
+#endif
+#ifdef MORPHOLOGY_AVX2
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_max_epu8(a, b); }
+#endif
+};
+
+//--------------------------------------------------------------------------------------
+// Combine three rows with an operation. Used both down the columns and, with the same row
+// offset by one and two pixels, along a row.
+//--------------------------------------------------------------------------------------
+template <typename Op>
+static void combine3(const uchar *a, const uchar *b, const uchar *c, uchar *out, int n) {
+
+    int x = 0;
+#ifdef MORPHOLOGY_AVX2
+    if (haveAVX2) {
+        for (; x <= n - 32; x += 32) {
+            __m256i v = Op::apply(_mm256_loadu_si256((const __m256i*)(a + x)), _mm256_loadu_si256((const __m256i*)(b + x)));
+            v = Op::apply(v, _mm256_loadu_si256((const __m256i*)(c + x)));
+            _mm256_storeu_si256((__m256i*)(out + x), v);
+        }
+        _mm256_zeroupper();
+    }
+#endif
+#ifdef MORPHOLOGY_SSE2
+    if (haveSSE2) {
+        for (; x <= n - 16; x += 16) {
+            __m128i v = Op::apply(_mm_loadu_si128((const __m128i*)(a + x)), _mm_loadu_si128((const __m128i*)(b + x)));
+            v = Op::apply(v, _mm_loadu_si128((const __m128i*)(c + x)));
+            _mm_storeu_si128((__m128i*)(out + x), v);
+        }
+    }
+#endif
+    for (; x < n; x++) {
+        out[x] = Op::apply(Op::apply(a[x], b[x]), c[x]);
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Horizontal max of a padded row, thresholded on the way out
+//--------------------------------------------------------------------------------------
+static void max3Threshold(const uchar *row, uchar *out, int n, int thresh, int type) {
+
+    const uchar *a = row;
+    const uchar *b = row + 1;
+    const uchar *c = row + 2;
+    const bool binary = type == cv::THRESH_BINARY;
+    int x = 0;
+#ifdef MORPHOLOGY_AVX2
+    if (haveAVX2) {
+        const __m256i above = _mm256_set1_epi8((char)(thresh + 1));
+        for (; x <= n - 32; x += 32) {
+            __m256i v = _mm256_max_epu8(_mm256_loadu_si256((const __m256i*)(a + x)), _mm256_loadu_si256((const __m256i*)(b + x)));
+            v = _mm256_max_epu8(v, _mm256_loadu_si256((const __m256i*)(c + x)));
+            __m256i mask = _mm256_cmpeq_epi8(_mm256_max_epu8(v, above), v);
+            _mm256_storeu_si256((__m256i*)(out + x), binary ? mask : _mm256_and_si256(v, mask));
+        }
+        _mm256_zeroupper();
+    }
+#endif
+#ifdef MORPHOLOGY_SSE2
+    if (haveSSE2) {
+        const __m128i above = _mm_set1_epi8((char)(thresh + 1));
+        for (; x <= n - 16; x += 16) {
+            __m128i v = _mm_max_epu8(_mm_loadu_si128((const __m128i*)(a + x)), _mm_loadu_si128((const __m128i*)(b + x)));
+            v = _mm_max_epu8(v, _mm_loadu_si128((const __m128i*)(c + x)));
+            __m128i mask = _mm_cmpeq_epi8(_mm_max_epu8(v, above), v);
+            _mm_storeu_si128((__m128i*)(out + x), binary ? mask : _mm_and_si128(v, mask));
+        }
+    }
+#endif
+    for (; x < n; x++) {
+        uchar v = std::max(std::max(a[x], b[x]), c[x]);
+        out[x] = v > thresh ? (binary ? 255 : v) : 0;
+    }
+
+}
+
+void openThreshold3x3(const cv::Mat &src, cv::Mat &dst, int thresh, int type) {
+
+    dst.create(src.size(), CV_8UC1);
+    openThreshold3x3(src, dst, thresh, type, cv::Range(0, src.rows));
+
+}
+
+//--------------------------------------------------------------------------------------
+// Stream down the rows, keeping the last three eroded rows and dilating each output row
+// from them. Pixels past the edges are left out of the min and max, as the default
+// morphology border does, by repeating the edge row or column in their place.
+//--------------------------------------------------------------------------------------
+void openThreshold3x3(const cv::Mat &src, cv::Mat &dst, int thresh, int type, const cv::Range &rows) {
+
+    CV_Assert(src.type() == CV_8UC1 && dst.type() == CV_8UC1 && dst.size() == src.size() && src.data != dst.data);
+    CV_Assert((type == cv::THRESH_TOZERO || type == cv::THRESH_BINARY) && thresh >= 0 && thresh < 255);
+
+    const int height = src.rows;
+    const int cols = src.cols;
+    if (rows.start >= rows.end || cols == 0) {
+        return;
+    }
+
+    // The erode reads up to one pixel past src's edges, where the image it is part of has them
+    cv::Size whole;
+    cv::Point ofs;
+    src.locateROI(whole, ofs);
+    const int haloTop = std::min(1, ofs.y);
+    const int haloBottom = std::min(1, whole.height - ofs.y - height);
+    const int haloLeft = std::min(1, ofs.x);
+    const int haloRight = std::min(1, whole.width - ofs.x - cols);
+
+    // Padded rows: element 0 is column -1, element cols + 1 is column cols
+    const int padded = cols + 2;
+    cv::AutoBuffer<uchar, 8192> buffer(padded * 5);
+    uchar *columnMin = buffer;
+    uchar *columnMax = columnMin + padded;
+    uchar *eroded[3] = { columnMax + padded, columnMax + 2 * padded, columnMax + 3 * padded };
+
+    const int erodeFirst = std::max(rows.start - 1, 0);
+    const int erodeLast = std::min(rows.end, height - 1);
+    int erodeNext = erodeFirst;
+    for (int y = rows.start; y < rows.end; y++) {
+        // Erode the rows this output row needs that haven't been yet
+        for (; erodeNext <= std::min(y + 1, erodeLast); erodeNext++) {
+            const int e = erodeNext;
+            const uchar *middle = src.ptr<uchar>(e) - haloLeft;
+            const uchar *above = e - 1 >= -haloTop ? middle - src.step : middle;
+            const uchar *below = e + 1 < height + haloBottom ? middle + src.step : middle;
+            uchar *vertical = columnMin + 1 - haloLeft;
+            combine3<MinOp>(above, middle, below, vertical, cols + haloLeft + haloRight);
+            if (!haloLeft) {
+                columnMin[0] = columnMin[1];
+            }
+            if (!haloRight) {
+                columnMin[cols + 1] = columnMin[cols];
+            }
+            combine3<MinOp>(columnMin, columnMin + 1, columnMin + 2, eroded[e % 3], cols);
+        }
+
+        // Dilate from the eroded rows inside the image, then threshold
+        const uchar *middle = eroded[y % 3];
+        const uchar *above = y > 0 ? eroded[(y - 1) % 3] : middle;
+        const uchar *below = y + 1 < height ? eroded[(y + 1) % 3] : middle;
+        combine3<MaxOp>(above, middle, below, columnMax + 1, cols);
+        columnMax[0] = columnMax[1];
+        columnMax[cols + 1] = columnMax[cols];
+        max3Threshold(columnMax, dst.ptr<uchar>(y), cols, thresh, type);
+    }
+
+}
@@ -0,0 +1,18 @@
+//--------------------------------------------------------------------------------------
+// File: Morphology.h
+//
+// This file contains the definitions for the fused 3x3 morphology used to clean up back
+// projections and masks
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "OpenCVToolkit.h"
+
+// 3x3 open (erode then dilate) followed by a cv::THRESH_TOZERO or cv::THRESH_BINARY threshold, in a
+// single streaming pass. Matches cv::erode, cv::dilate and cv::threshold run one after the other:
+// where src is a region of a larger image the erode reads one pixel past its edges, as cv::erode does.
+extern void openThreshold3x3(const cv::Mat &src, cv::Mat &dst, int thresh, int type);
+// As above, for a range of output rows only, into dst already created at the size of src, so stripes
+// can run in parallel without waiting for each other
+extern void openThreshold3x3(const cv::Mat &src, cv::Mat &dst, int thresh, int type, const cv::Range &rows);
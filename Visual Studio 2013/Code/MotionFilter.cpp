@@ -0,0 +1,149 @@
+//--------------------------------------------------------------------------------------
+// File: MotionFilter.cpp
+//
+// This file contains the implementations for filtering and extrapolating tracked positions
+//--------------------------------------------------------------------------------------
+
+#include "MotionFilter.h"
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+MotionFilter::MotionFilter(double processNoise, double measurementNoise, double maxPrediction)
+    : processNoise(processNoise), measurementNoise(measurementNoise), maxPrediction(maxPrediction) {
+
+    reset();
+
+}
+
+//--------------------------------------------------------------------------------------
+// Forget the target, so the next measurement starts the filter again
+//--------------------------------------------------------------------------------------
+void MotionFilter::reset() {
+
+    x.reset(0.0);
+    y.reset(0.0);
+    size.reset(0.0);
+    lastTime = 0.0;
+    valid = false;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Fold in a new measurement. Frames where the target wasn't found are skipped, leaving
+// the filter to coast on its last velocity.
+//--------------------------------------------------------------------------------------
+void MotionFilter::update(const TrackResult &result) {
+
+    if (result.radius == 0.f) {
+        return;
+    }
+
+    double area = depthArea(result);
+    double dt = result.timestamp - lastTime;
+
+    // Start again on the first measurement, or if the target has been gone for too long
+    if (!valid || dt <= 0.0 || dt > maxPrediction * 4.0) {
+        x.reset(result.centroid.x);
+        y.reset(result.centroid.y);
+        size.reset(area);
+        lastTime = result.timestamp;
+        valid = true;
+        return;
+    }
+
+    double q = processNoise * processNoise;
+    double r = measurementNoise * measurementNoise;
+    x.predict(dt, q);
+    y.predict(dt, q);
+    size.predict(dt, q);
+    x.correct(result.centroid.x, r);
+    y.correct(result.centroid.y, r);
+    // Area grows with the square of the ball's size, so its noise does as well
+    size.correct(area, r * area);
+    lastTime = result.timestamp;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Position extrapolated to a given time
+//--------------------------------------------------------------------------------------
+cv::Point2f MotionFilter::predictPosition(double time) const {
+
+    double dt = predictionTime(time);
+    return cv::Point2f((float)x.at(dt), (float)y.at(dt));
+
+}
+
+//--------------------------------------------------------------------------------------
+// Size extrapolated to a given time
+//--------------------------------------------------------------------------------------
+float MotionFilter::predictSize(double time) const {
+
+    return (float)std::max(size.at(predictionTime(time)), 0.0);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Time since the last measurement, limited so a lost target doesn't fly off
+//--------------------------------------------------------------------------------------
+double MotionFilter::predictionTime(double time) const {
+
+    if (!valid) {
+        return 0.0;
+    }
+    return std::max(0.0, std::min(time - lastTime, maxPrediction));
+
+}
+
+//--------------------------------------------------------------------------------------
+// Start an axis at a position, at rest but with a wide velocity uncertainty
+//--------------------------------------------------------------------------------------
+void MotionFilter::Axis::reset(double position) {
+
+    p = position;
+    v = 0.0;
+    p00 = 1.0;
+    p01 = 0.0;
+    p11 = 1e6;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Advance the axis by dt, under white noise acceleration with variance q
+//--------------------------------------------------------------------------------------
+void MotionFilter::Axis::predict(double dt, double q) {
+
+    p += v * dt;
+
+    double dt2 = dt * dt;
+    double n00 = p00 + 2.0 * dt * p01 + dt2 * p11 + q * dt2 * dt2 / 4.0;
+    double n01 = p01 + dt * p11 + q * dt2 * dt / 2.0;
+    double n11 = p11 + q * dt2;
+    p00 = n00;
+    p01 = n01;
+    p11 = n11;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Correct the axis with a position measurement z, of variance r
+//--------------------------------------------------------------------------------------
+void MotionFilter::Axis::correct(double z, double r) {
+
+    double s = p00 + r;
+    double k0 = p00 / s;
+    double k1 = p01 / s;
+    double innovation = z - p;
+
+    p += k0 * innovation;
+    v += k1 * innovation;
+
+    double n00 = (1.0 - k0) * p00;
+    double n01 = (1.0 - k0) * p01;
+    double n11 = p11 - k1 * p01;
+    p00 = n00;
+    p01 = n01;
+    p11 = n11;
+
+}
@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// File: MotionFilter.h
+//
+// This file contains the definitions for filtering and extrapolating tracked positions
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "OpenCVToolkit.h"
+
+//--------------------------------------------------------------------------------------
+// Constant velocity Kalman filter for a single tracked target, filtering its position and
+// size independently per axis. Measurements are stamped with their capture time, so the
+// target can be extrapolated to the time it is actually drawn at.
+//--------------------------------------------------------------------------------------
+class MotionFilter {
+public:
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    // Constructor
+    MotionFilter(double processNoise = 4000.0, double measurementNoise = 4.0, double maxPrediction = 0.1);
+
+    // Measurements
+    void reset();
+    void update(const TrackResult &result);
+
+    // Filtered state, extrapolated to the given time in seconds
+    cv::Point2f predictPosition(double time) const;
+    float predictSize(double time) const;
+    bool isValid() const { return valid; };
+
+private:
+    //--------------------------------------------------------------------------------------
+    // Variables
+    //--------------------------------------------------------------------------------------
+
+    // Position, velocity and their covariance along one axis
+    struct Axis {
+        double p, v;
+        double p00, p01, p11;
+
+        void reset(double position);
+        void predict(double dt, double q);
+        void correct(double z, double r);
+        double at(double dt) const { return p + v * dt; };
+    };
+
+    Axis x, y, size;
+    double lastTime;
+    bool valid;
+
+    // Noise of the acceleration driving the model (pixels/s^2), of the measurements (pixels),
+    // and the furthest the filter will extrapolate past its last measurement (s)
+    double processNoise;
+    double measurementNoise;
+    double maxPrediction;
+
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    double predictionTime(double time) const;
+};
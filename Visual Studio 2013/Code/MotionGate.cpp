@@ -0,0 +1,121 @@
+//--------------------------------------------------------------------------------------
+// File: MotionGate.cpp
+//
+// This file contains the implementations for gating the tracking pipeline on frame-to-frame
+// motion
+//--------------------------------------------------------------------------------------
+
+#include "MotionGate.h"
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+MotionGate::MotionGate(int scale, int tileSize, int diffThreshold, float minChangedRatio)
+    : scale(std::max(scale, 1)), tileSize(std::max(tileSize, 1)), diffThreshold(diffThreshold), minChangedRatio(minChangedRatio), admitted(0), skipped(0) {
+
+}
+
+//--------------------------------------------------------------------------------------
+// Shrink the frame, difference it with each tile's reference, and average the difference
+// over each tile. Shrinking by area averaging smooths out most of the sensor noise first.
+// BGR and YUYV frames are both taken.
+//--------------------------------------------------------------------------------------
+bool MotionGate::update(const cv::Mat &frame) {
+
+    cv::Size size(std::max(frame.cols / scale, 1), std::max(frame.rows / scale, 1));
+    cv::Size tileCount((size.width + tileSize - 1) / tileSize, (size.height + tileSize - 1) / tileSize);
+    cv::resize(frame, shrunk, size, 0, 0, cv::INTER_AREA);
+    if (frame.type() == CV_8UC2) {
+        // The first channel of YUYV is already luma
+        cv::extractChannel(shrunk, grey, 0);
+    } else {
+        cv::cvtColor(shrunk, grey, CV_BGR2GRAY);
+    }
+
+    bool first = previous.size() != size || frameSize != frame.size();
+    frameSize = frame.size();
+    if (first) {
+        grey.copyTo(previous);
+        tiles.create(tileCount, CV_8UC1);
+        tiles.setTo(cv::Scalar(255));
+        movingBounds = cv::Rect(0, 0, frame.cols, frame.rows);
+        return true;
+    }
+
+    cv::absdiff(grey, previous, changed);
+    cv::threshold(changed, changed, diffThreshold, 255, cv::THRESH_BINARY);
+
+    // Tiles at the edges may be partly outside the shrunk frame, so count each tile's share of
+    // changed pixels over the pixels it actually covers
+    tiles.create(tileCount, CV_8UC1);
+    cv::Point low(tileCount.width, tileCount.height), high(-1, -1);
+    for (int ty = 0; ty < tileCount.height; ty++) {
+        uchar *tile = tiles.ptr<uchar>(ty);
+        const int y0 = ty * tileSize, y1 = std::min(y0 + tileSize, size.height);
+        for (int tx = 0; tx < tileCount.width; tx++) {
+            const int x0 = tx * tileSize, x1 = std::min(x0 + tileSize, size.width);
+            int count = 0;
+            for (int y = y0; y < y1; y++) {
+                const uchar *row = changed.ptr<uchar>(y);
+                for (int x = x0; x < x1; x++) {
+                    count += row[x] != 0;
+                }
+            }
+            bool moved = count > minChangedRatio * (y1 - y0) * (x1 - x0);
+            tile[tx] = moved ? 255 : 0;
+            if (moved) {
+                // Only tiles that moved take this frame as their reference, so motion too slow
+                // to show between two frames still adds up until it does
+                const cv::Rect tileRect(x0, y0, x1 - x0, y1 - y0);
+                cv::Mat reference = previous(tileRect);
+                grey(tileRect).copyTo(reference);
+                low = cv::Point(std::min(low.x, tx), std::min(low.y, ty));
+                high = cv::Point(std::max(high.x, tx), std::max(high.y, ty));
+            }
+        }
+    }
+
+    if (high.x < 0) {
+        movingBounds = cv::Rect();
+        return false;
+    }
+    // The last tiles also cover the frame pixels left over from shrinking it
+    const int tilePixels = tileSize * scale;
+    cv::Point end((high.x + 1) * tilePixels, (high.y + 1) * tilePixels);
+    end.x = high.x == tileCount.width - 1 ? frame.cols : end.x;
+    end.y = high.y == tileCount.height - 1 ? frame.rows : end.y;
+    movingBounds = cv::Rect(cv::Point(low.x * tilePixels, low.y * tilePixels), end) & cv::Rect(0, 0, frame.cols, frame.rows);
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Check the tiles under an area of the frame
+//--------------------------------------------------------------------------------------
+bool MotionGate::admit(const cv::Rect &area) {
+
+    bool moved = false;
+    const int tilePixels = tileSize * scale;
+    cv::Rect clipped = area & movingBounds;
+    if (clipped.area() > 0) {
+        const int tx0 = std::min(clipped.x / tilePixels, tiles.cols - 1), tx1 = std::min((clipped.x + clipped.width - 1) / tilePixels, tiles.cols - 1);
+        const int ty0 = std::min(clipped.y / tilePixels, tiles.rows - 1), ty1 = std::min((clipped.y + clipped.height - 1) / tilePixels, tiles.rows - 1);
+        for (int ty = ty0; ty <= ty1 && !moved; ty++) {
+            const uchar *tile = tiles.ptr<uchar>(ty);
+            for (int tx = tx0; tx <= tx1; tx++) {
+                if (tile[tx]) {
+                    moved = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (moved) {
+        admitted++;
+    } else {
+        skipped++;
+    }
+    return moved;
+
+}
@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------
+// File: MotionGate.h
+//
+// This file contains the definitions for gating the tracking pipeline on frame-to-frame
+// motion, so static scenes cost next to nothing
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+
+#include "OpenCVToolkit.h"
+
+//--------------------------------------------------------------------------------------
+// Compares each frame on a small greyscale copy with the frame each tile last moved on, and
+// marks the tiles where enough of it changed. Tracking work in an area is only needed when a
+// tile over it moved, otherwise the last result there still stands.
+//--------------------------------------------------------------------------------------
+class MotionGate {
+public:
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    // Frames are shrunk by scale, and split into tiles of tileSize by tileSize shrunk pixels.
+    // A tile moved when more than minChangedRatio of its pixels changed by over diffThreshold.
+    MotionGate(int scale = 8, int tileSize = 4, int diffThreshold = 16, float minChangedRatio = 0.05f);
+
+    // Compare a frame with the tiles' references. Returns whether any tile moved.
+    bool update(const cv::Mat &frame);
+    // Treat the next frame as moving everywhere, such as after a camera change
+    void reset() { previous.release(); };
+
+    // Whether any tile over an area of the frame moved, counting the decision towards the skip ratio
+    bool admit(const cv::Rect &area);
+    // Bounds of all the tiles that moved, in frame coordinates
+    cv::Rect getMovingBounds() const { return movingBounds; };
+
+    // Fraction of the areas asked about that could be skipped
+    double getSkipRatio() const { return admitted + skipped ? (double)skipped / (admitted + skipped) : 0.0; };
+    void resetStats() { admitted = 0; skipped = 0; };
+
+private:
+    //--------------------------------------------------------------------------------------
+    // Variables
+    //--------------------------------------------------------------------------------------
+
+    int scale;
+    int tileSize;
+    int diffThreshold;
+    float minChangedRatio;
+
+    // Shrunk greyscale frame, the frame each tile last moved on, their difference, and one
+    // byte per tile set where it moved
+    cv::Mat shrunk;
+    cv::Mat grey;
+    cv::Mat previous;
+    cv::Mat changed;
+    cv::Mat tiles;
+    cv::Size frameSize;
+    cv::Rect movingBounds;
+
+    // Areas admitted and skipped. Read from other threads for the metric.
+    std::atomic<unsigned long> admitted;
+    std::atomic<unsigned long> skipped;
+
+    MotionGate(const MotionGate&);
+    MotionGate &operator=(const MotionGate&);
+};
@@ -1,7 +1,8 @@
 #include "OpenCVToolkit.h"
-
-cv::Mat frame;
-cv::VideoCapture webcam(0);
+#include "PipelineProfiler.h"
+#include "BackProjectLUT.h"
+#include "Morphology.h"
+#include "MotionGate.h"
 
 // camera setting
 const cv::Size frameSize = cv::Size(640, 480);
@@ -33,78 +34,912 @@ const int thre = 100;
 // Flood fill local tolerance
 const int tolerance = 200;
 
+// Windowed search setting
+// Pixels searched around the last bounding box, on top of half the box size
+const int searchMargin = 24;
+// Fraction of the last area below which the target counts as lost
+const float minAreaRatio = 0.25f;
+// Fraction of the last area the area may change by while the target counts as steady
+const float stableAreaRatio = 0.2f;
+
+// Convert a frame to HSV for back projection
+static void convertToHsv(const cv::Mat &frame, cv::Mat &hsv, PipelineProfiler *profiler) {
+
+    ScopedStageTimer timer(profiler, STAGE_CONVERT);
+    cv::cvtColor(frame, hsv, CV_RGB2HSV);
+
+}
+
+// A view of a workspace buffer at the size a stage needs, growing the buffer if it is too small.
+// The view is an image of its own rather than a region of the buffer, so filters don't read
+// stale pixels past its edges.
+static cv::Mat bufferView(cv::Mat &buffer, cv::Size size, int type, unsigned long &allocations) {
+
+    if (buffer.type() != type || buffer.total() < (size_t)size.area()) {
+        buffer.create(size, type);
+        allocations++;
+    }
+    return cv::Mat(size, type, buffer.data);
+
+}
+
+// Resize a workspace vector, counting it if it has to grow past what was reserved
+template <typename T>
+static void fitBuffer(vector<T> &buffer, size_t size, unsigned long &allocations) {
+
+    if (size > buffer.capacity()) {
+        allocations++;
+    }
+    buffer.resize(size);
+
+}
+
+// Most provisional labels the labeller can hand out. While any two marked pixels are within the
+// tolerance only every other pixel can start a region, otherwise every pixel might.
+static size_t maxProvisionalLabels(cv::Size size, const TrackerParams &params) {
+
+    if (params.tolerance >= 255 - (params.thre + 1)) {
+        return ((size_t)size.area() + 1) / 2 + 1;
+    }
+    return (size_t)size.area() + 1;
+
+}
+
+// Size a workspace mask, counting it if it has to grow past what was reserved
+static void fitMask(BitMask &mask, cv::Size size, unsigned long &allocations) {
+
+    size_t capacity = mask.capacity();
+    mask.create(size.height, size.width);
+    if (mask.capacity() != capacity) {
+        allocations++;
+    }
+
+}
+
+// Fewest rows worth handing to a thread of their own
+static const int minStripeRows = 16;
+
+// Number of stripes to split an image of the given height into
+static int stripeCount(int rows, int stripes) {
+
+    return std::max(1, std::min(stripes, rows / minStripeRows));
+
+}
+
+// Rows of a stripe. The boundaries depend only on the image height and stripe count, so the
+// labeller can find its seams again afterwards.
+static cv::Range stripeRows(int rows, int stripes, int stripe) {
+
+    return cv::Range(rows * stripe / stripes, rows * (stripe + 1) / stripes);
+
+}
+
+// Runs body(stripe, rows) for every stripe of an image on OpenCV's thread pool
+template <typename Body>
+class StripeLoop : public cv::ParallelLoopBody {
+public:
+    StripeLoop(int rows, int stripes, const Body &body) : rows(rows), stripes(stripes), body(body) {}
+
+    void operator()(const cv::Range &range) const {
+        for (int stripe = range.start; stripe < range.end; stripe++) {
+            body(stripe, stripeRows(rows, stripes, stripe));
+        }
+    }
+
+private:
+    int rows;
+    int stripes;
+    const Body &body;
+
+    StripeLoop &operator=(const StripeLoop&);
+};
+
+template <typename Body>
+static void forEachStripe(int rows, int stripes, const Body &body) {
+
+    if (stripes <= 1) {
+        body(0, cv::Range(0, rows));
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, stripes), StripeLoop<Body>(rows, stripes, body), stripes);
+
+}
+
+// Runs body(i) for every target, concurrently when asked to
+template <typename Body>
+class TargetLoop : public cv::ParallelLoopBody {
+public:
+    TargetLoop(const Body &body) : body(body) {}
+
+    void operator()(const cv::Range &range) const {
+        for (int i = range.start; i < range.end; i++) {
+            body((size_t)i);
+        }
+    }
+
+private:
+    const Body &body;
+
+    TargetLoop &operator=(const TargetLoop&);
+};
+
+template <typename Body>
+static void forEachTarget(size_t count, bool concurrent, const Body &body) {
+
+    if (!concurrent || count < 2) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, (int)count), TargetLoop<Body>(body), (double)count);
+
+}
+
+void TrackerWorkspace::reserve(cv::Size size, size_t targetCount) {
+
+    searched.create(size, CV_8UC3);
+    hsv.create(size, CV_8UC3);
+
+    targets.resize(targetCount);
+    for (size_t i = 0; i < targetCount; i++) {
+        TargetWorkspace &target = targets[i];
+        target.backProject.create(size, CV_8UC1);
+        target.refineBackProject.create(size, CV_8UC1);
+        target.region.create(size, CV_8UC1);
+        // Every stripe has its own block of labels, each at most two more than its share of one block
+        target.stripes = stripes;
+        target.params = params;
+        target.labels.reserve(size.area());
+        target.parent.reserve(std::max(maxProvisionalLabels(size, params) + 2 * stripes, maxMaskRuns(size)));
+        target.index.reserve(maxProvisionalLabels(size, params) + 2 * stripes);
+        target.mask.reserve(size.height, size.width);
+        target.maskScratch.reserve(size.height, size.width);
+        target.runs.reserve(maxMaskRuns(size));
+        // Opened blobs each hold a 2x2 block and are apart, so no two of those start in one 3x3 cell
+        target.blobs.reserve((size_t)((size.width + 2) / 3) * ((size.height + 2) / 3));
+        target.stripeFirstLabel.reserve(stripes);
+        target.stripeLabelCount.reserve(stripes);
+        target.incremental = incremental;
+        target.profiler = profiler;
+        if (incremental) {
+            target.incrementalBlobs.reserve(size.height, size.width);
+            target.incrementalBlobs.setMaxDirtyRatio(maxDirtyRatio);
+        }
+    }
+
+    detect.reserve(targetCount);
+    locked.reserve(targetCount);
+    lost.reserve(targetCount);
+    hists.reserve(targetCount);
+    luts.reserve(targetCount);
+    backProjects.reserve(targetCount);
+
+}
+
+unsigned long TrackerWorkspace::allocationCount() const {
+
+    unsigned long count = allocations;
+    for (size_t i = 0; i < targets.size(); i++) {
+        count += targets[i].allocations;
+    }
+    return count;
+
+}
+
 void regionMark(const cv::Mat &frame, const cv::MatND &hsv_hist, cv::Mat &markMap) {
 
     // Back projection operation
     cv::Mat hsv;
     cv::Mat backProject;
-    cv::Mat binary(frameSize, CV_8UC3);
-    cvtColor(frame, hsv, CV_RGB2HSV);
-    cv::cvtColor(frame, hsv, CV_RGB2HSV);
+    convertToHsv(frame, hsv, nullptr);
     cv::calcBackProject(&hsv, 1, hsv_channels, hsv_hist, backProject, ranges);
-    // Remove noise
-    cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-    erode(backProject, binary, element);
-    cv::dilate(binary, binary, element);
-    //imshow("Back Projection", binary);
-
-    // Mark regions by using flood fill
-    markMap = binary.clone();
-
-    threshold(binary, markMap, thre, 255, cv::THRESH_TOZERO);
-    // Operation mask that should be a single-channel 8-bit image, 2 pixels wider and 2 pixels taller than image
-    cv::Mat mask = cv::Mat::zeros(cv::Size(frameSize.width + 2, frameSize.height + 2), CV_8UC1);
-    cv::Mat inverseMask = mask.clone();
-    cv::Mat maskROI = mask(cv::Rect(1, 1, frameSize.width, frameSize.height));
-    cv::Mat inverseMaskROI = inverseMask(cv::Rect(1, 1, frameSize.width, frameSize.height));
-    // Mat currentMask;
-    threshold(markMap, maskROI, thre, 255, cv::THRESH_BINARY);
-    threshold(markMap, inverseMaskROI, thre, 255, cv::THRESH_BINARY_INV);
-    // Find marking locations
-    int index = thre + 1;
-    vector<cv::Point> markLoc;
-    findNonZero(maskROI, markLoc);
-    while (markLoc.size() != 0) {
-        cv::Point seed = markLoc[0];
-        floodFill(markMap, inverseMask, seed, cv::Scalar(static_cast<uchar>(index++)), (cv::Rect*)0, cv::Scalar(tolerance), cv::Scalar(tolerance), 4 | (static_cast<uchar>(255) << 8));
-        bitwise_not(inverseMaskROI, maskROI);
-        findNonZero(maskROI, markLoc);
-    }
-
-}
-
-void updateTrackAndSize(const cv::Mat &frame, const cv::MatND &hsv_hist, cv::Point &point, cv::Size &size) {
-    cv::Point trackedCentre;
+
+    regionMarkBackProject(backProject, markMap);
+
+}
+
+void regionMarkBackProject(const cv::Mat &backProject, cv::Mat &markMap) {
+
+    TargetWorkspace workspace;
+    regionMarkBackProject(backProject, markMap, workspace);
+
+}
+
+void regionMarkBackProject(const cv::Mat &backProject, cv::Mat &markMap, TargetWorkspace &workspace) {
+
+    // Remove noise and mark regions in one pass. Each stripe erodes the rows either side of it
+    // as well, so no stripe has to wait for its neighbours.
+    const TrackerParams &params = workspace.params;
+    markMap.create(backProject.size(), CV_8UC1);
+    if (params.denoiseKernel == 3) {
+        ScopedStageTimer timer(workspace.profiler, STAGE_DENOISE);
+        forEachStripe(backProject.rows, stripeCount(backProject.rows, workspace.stripes), [&](int, const cv::Range &rows) {
+            openThreshold3x3(backProject, markMap, params.thre, cv::THRESH_TOZERO, rows);
+        });
+    } else {
+        // Other kernel sizes take OpenCV's separate passes
+        ScopedStageTimer timer(workspace.profiler, STAGE_DENOISE);
+        cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(params.denoiseKernel, params.denoiseKernel));
+        cv::erode(backProject, markMap, element);
+        cv::dilate(markMap, markMap, element);
+        cv::threshold(markMap, markMap, params.thre, 255, cv::THRESH_TOZERO);
+    }
+
+    // Mark regions in a single labelling sweep
+    ScopedStageTimer timer(workspace.profiler, STAGE_LABEL);
+    labelRegions(markMap, workspace);
+
+}
+
+// Union-find helpers for the region labeller
+static int findRoot(vector<int> &parent, int label) {
+
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+
+}
+
+static void unite(vector<int> &parent, int a, int b) {
+
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a < b) {
+        parent[b] = a;
+    } else if (b < a) {
+        parent[a] = b;
+    }
+
+}
+
+void labelRegions(cv::Mat &markMap) {
+
+    TargetWorkspace workspace;
+    labelRegions(markMap, workspace);
+
+}
+
+// First labelling pass over a stripe: give each marked pixel a provisional label, joining it with
+// its left and upper 4-connected neighbours in the stripe when they are within the flood fill
+// tolerance. Labels are handed out from the stripe's own block of the parent table.
+static int labelStripe(const cv::Mat &markMap, const cv::Range &rows, int *labels, vector<int> &parent, int firstLabel, int thre, int tolerance) {
+
+    const int cols = markMap.cols;
+    int next = firstLabel;
+    for (int y = rows.start; y < rows.end; y++) {
+        const uchar *row = markMap.ptr<uchar>(y);
+        const uchar *up = y > rows.start ? markMap.ptr<uchar>(y - 1) : 0;
+        int *label = &labels[y * cols];
+        const int *labelUp = y > rows.start ? label - cols : 0;
+        for (int x = 0; x < cols; x++) {
+            int value = row[x];
+            if (value <= thre) {
+                label[x] = -1;
+                continue;
+            }
+            int current = -1;
+            if (x > 0 && label[x - 1] >= 0 && abs(value - row[x - 1]) <= tolerance) {
+                current = label[x - 1];
+            }
+            if (up && labelUp[x] >= 0 && abs(value - up[x]) <= tolerance) {
+                if (current < 0) {
+                    current = labelUp[x];
+                } else {
+                    unite(parent, current, labelUp[x]);
+                }
+            }
+            if (current < 0) {
+                current = next++;
+                parent[current] = current;
+            }
+            label[x] = current;
+        }
+    }
+    return next - firstLabel;
+
+}
+
+// Label the connected marked pixels from runs of a bit mask of them. Only valid while every
+// pair of marked pixels is within the tolerance, so that neighbours always join.
+static void labelMaskRuns(cv::Mat &markMap, TargetWorkspace &workspace) {
+
+    const int rows = markMap.rows;
+    BitMask &mask = workspace.mask;
+    vector<MaskRun> &runs = workspace.runs;
+    fitMask(mask, markMap.size(), workspace.allocations);
+    forEachStripe(rows, stripeCount(rows, workspace.stripes), [&](int, const cv::Range &stripeRange) {
+        thresholdToMask(markMap, workspace.params.thre, mask, stripeRange);
+    });
+
+    size_t capacity = runs.capacity();
+    extractRuns(mask, runs);
+    if (runs.capacity() != capacity) {
+        workspace.allocations++;
+    }
+    fitBuffer(workspace.parent, runs.size(), workspace.allocations);
+    labelRuns(runs, workspace.parent, false);
+
+    // Runs are labelled in the order of their first pixel, as the flood fill seeds were
+    for (size_t i = 0; i < runs.size(); i++) {
+        const MaskRun &run = runs[i];
+        uchar *row = markMap.ptr<uchar>(run.y);
+        std::fill(row + run.start, row + run.end, static_cast<uchar>(workspace.params.thre + 1 + run.label));
+    }
+
+}
+
+void labelRegions(cv::Mat &markMap, TargetWorkspace &workspace) {
+
+    CV_Assert(markMap.type() == CV_8UC1);
+
+    const int thre = workspace.params.thre;
+    const int tolerance = workspace.params.tolerance;
+    if (tolerance >= 255 - (thre + 1)) {
+        labelMaskRuns(markMap, workspace);
+        return;
+    }
+
+    const int rows = markMap.rows;
+    const int cols = markMap.cols;
+    const int stripes = stripeCount(rows, workspace.stripes);
+    vector<int> &labels = workspace.labels;
+    vector<int> &parent = workspace.parent;
+    vector<int> &index = workspace.index;
+    vector<int> &firstLabel = workspace.stripeFirstLabel;
+    vector<int> &labelCount = workspace.stripeLabelCount;
+    fitBuffer(labels, (size_t)rows * cols, workspace.allocations);
+    fitBuffer(firstLabel, stripes, workspace.allocations);
+    fitBuffer(labelCount, stripes, workspace.allocations);
+
+    // Each stripe gets a block big enough for all the labels it could hand out. Labels only ever
+    // point at smaller ones, and each region's smallest label is that of its first pixel.
+    int total = 0;
+    for (int stripe = 0; stripe < stripes; stripe++) {
+        firstLabel[stripe] = total;
+        total += (int)maxProvisionalLabels(cv::Size(cols, stripeRows(rows, stripes, stripe).size()), workspace.params);
+    }
+    fitBuffer(parent, total, workspace.allocations);
+    fitBuffer(index, total, workspace.allocations);
+
+    forEachStripe(rows, stripes, [&](int stripe, const cv::Range &stripeRange) {
+        labelCount[stripe] = labelStripe(markMap, stripeRange, &labels[0], parent, firstLabel[stripe], thre, tolerance);
+    });
+
+    // Join the regions that continue across the seams between stripes
+    for (int stripe = 1; stripe < stripes; stripe++) {
+        const int y = stripeRows(rows, stripes, stripe).start;
+        const uchar *row = markMap.ptr<uchar>(y);
+        const uchar *up = markMap.ptr<uchar>(y - 1);
+        const int *label = &labels[y * cols];
+        const int *labelUp = label - cols;
+        for (int x = 0; x < cols; x++) {
+            if (label[x] >= 0 && labelUp[x] >= 0 && abs(row[x] - up[x]) <= tolerance) {
+                unite(parent, label[x], labelUp[x]);
+            }
+        }
+    }
+
+    // Number the regions in the order of their first pixel, as the flood fill seeds did. Walking
+    // the labels in increasing order reaches every root before the labels pointing at it.
+    int next = thre + 1;
+    for (int stripe = 0; stripe < stripes; stripe++) {
+        for (int l = firstLabel[stripe]; l < firstLabel[stripe] + labelCount[stripe]; l++) {
+            parent[l] = parent[parent[l]];
+            index[l] = parent[l] == l ? next++ : index[parent[l]];
+        }
+    }
+
+    // Second pass: write every pixel's region number
+    forEachStripe(rows, stripes, [&](int, const cv::Range &stripeRange) {
+        for (int y = stripeRange.start; y < stripeRange.end; y++) {
+            uchar *row = markMap.ptr<uchar>(y);
+            const int *label = &labels[y * cols];
+            for (int x = 0; x < cols; x++) {
+                if (label[x] >= 0) {
+                    row[x] = static_cast<uchar>(index[label[x]]);
+                }
+            }
+        }
+    });
+
+}
+
+void updateTrackAndSize(const cv::Mat &frame, const cv::MatND &hsv_hist, cv::Point &point, cv::Size &size, int pyramidLevel) {
+
+    if (pyramidLevel > 0) {
+        vector<TrackResult> results;
+        updateTracksAndSizes(frame, vector<cv::MatND>(1, hsv_hist), results, pyramidLevel);
+        point = results[0].point;
+        size = results[0].size;
+        return;
+    }
+
     //Find the largest region in the image
     cv::Mat region;
-    cv::Mat binary;
     regionMark(frame, hsv_hist, region);
-    cv::threshold(region, binary, thre, 255, cv::THRESH_BINARY);
-
-    //Morphological Operations
-    cv::Mat element3(3, 3, CV_8U, cv::Scalar(1));
-    cv::Mat openedImg(frame.cols, frame.rows, CV_8UC1);
-    cv::morphologyEx(binary, openedImg, cv::MORPH_OPEN, element3);
-
-    //find large object
-    int largest_area = 0;
-    int largest_contour_index = 0;
-    cv::Rect bounding_rect;
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(openedImg, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE);
-    for (int i = 0; i < contours.size(); i++) {         // Iterate through each contour
-        double a = cv::contourArea(contours[i]);        // Find the area of contour
-        if (a > largest_area) {
-            largest_area = a;
-            largest_contour_index = i;                  //Store the index of largest contour
-            bounding_rect = boundingRect(contours[i]);  // Find the bounding rectangle for biggest contour
-        }
-    }
-    size.width = bounding_rect.width;
-    size.height = bounding_rect.height;
-
-    //Scale object centre back to its original size
-    point.x = bounding_rect.x + bounding_rect.width / 2;
-    point.y = bounding_rect.y + bounding_rect.height / 2;
-
-}
\ No newline at end of file
+    findLargestRegion(region, point, size);
+
+}
+
+void findLargestRegion(const cv::Mat &region, cv::Point &point, cv::Size &size) {
+
+    TargetWorkspace workspace;
+    findLargestRegion(region, point, size, workspace);
+
+}
+
+void findLargestRegion(const cv::Mat &region, cv::Point &point, cv::Size &size, TargetWorkspace &workspace) {
+
+    BlobStats blob;
+    if (!findLargestBlob(region, blob, workspace)) {
+        point = cv::Point(0, 0);
+        size = cv::Size(0, 0);
+        return;
+    }
+
+    cv::Rect box = blob.box();
+    size = box.size();
+    point = cv::Point(box.x + box.width / 2, box.y + box.height / 2);
+
+}
+
+bool findLargestBlob(const cv::Mat &region, BlobStats &blob, TargetWorkspace &workspace) {
+
+    // Threshold to one bit per pixel and open that, 64 pixels to a word. Pixels past the edges
+    // of region are left out.
+    const int stripes = stripeCount(region.rows, workspace.stripes);
+    BitMask &mask = workspace.mask;
+    BitMask &eroded = workspace.maskScratch;
+    fitMask(mask, region.size(), workspace.allocations);
+    fitMask(eroded, region.size(), workspace.allocations);
+    {
+        ScopedStageTimer timer(workspace.profiler, STAGE_THRESHOLD);
+        forEachStripe(region.rows, stripes, [&](int, const cv::Range &rows) {
+            thresholdToMask(region, workspace.params.thre, mask, rows);
+        });
+    }
+    {
+        // A k x k open is (k - 1) / 2 3x3 erodes then as many dilates, each between the two masks
+        ScopedStageTimer timer(workspace.profiler, STAGE_OPEN);
+        const int passes = (workspace.params.maskKernel - 1) / 2;
+        BitMask *src = &mask;
+        BitMask *dst = &eroded;
+        for (int pass = 0; pass < 2 * passes; pass++) {
+            forEachStripe(region.rows, stripes, [&](int, const cv::Range &rows) {
+                if (pass < passes) {
+                    erodeMask(*src, *dst, rows);
+                } else {
+                    dilateMask(*src, *dst, rows);
+                }
+            });
+            std::swap(src, dst);
+        }
+    }
+
+    // Label the 8-connected blobs, as the contour search found them, summing their stats as the
+    // runs are numbered
+    vector<MaskRun> &runs = workspace.runs;
+    vector<BlobStats> &blobs = workspace.blobs;
+    if (workspace.incremental) {
+        // Only the bands of the mask that changed since the last frame are labelled again
+        ScopedStageTimer timer(workspace.profiler, STAGE_BLOBS);
+        size_t capacity = workspace.incrementalBlobs.capacity();
+        size_t blobCapacity = blobs.capacity();
+        workspace.incrementalBlobs.update(mask, blobs);
+        if (workspace.incrementalBlobs.capacity() != capacity || blobs.capacity() != blobCapacity) {
+            workspace.allocations++;
+        }
+    } else {
+        ScopedStageTimer timer(workspace.profiler, STAGE_BLOBS);
+        size_t runCapacity = runs.capacity();
+        size_t blobCapacity = blobs.capacity();
+        extractRuns(mask, runs);
+        fitBuffer(workspace.parent, runs.size(), workspace.allocations);
+        labelRuns(runs, workspace.parent, true, &blobs);
+        if (runs.capacity() != runCapacity || blobs.capacity() != blobCapacity) {
+            workspace.allocations++;
+        }
+    }
+
+    // Keep the first of the largest
+    ScopedStageTimer timer(workspace.profiler, STAGE_LARGEST);
+    const BlobStats *largest = nullptr;
+    for (size_t i = 0; i < blobs.size(); i++) {
+        if (!largest || blobs[i].area > largest->area) {
+            largest = &blobs[i];
+        }
+    }
+    if (!largest) {
+        return false;
+    }
+    blob = *largest;
+    return true;
+
+}
+
+// Build a lookup from an 8-bit channel value to its histogram bin, matching calcBackProject's uniform binning.
+// Values falling outside the range map to -1.
+void buildBinLookup(const float *range, int bins, int *lookup) {
+
+    double a = bins / (double)(range[1] - range[0]);
+    double b = -range[0] * a;
+    for (int v = 0; v < 256; v++) {
+        int idx = cvFloor(v * a + b);
+        lookup[v] = (idx >= 0 && idx < bins) ? idx : -1;
+    }
+
+}
+
+// Back project a range of rows, into back projections already created at the image size
+static void backProjectTargetRows(const cv::Mat &hsv, const vector<cv::MatND> &hsv_hists, vector<cv::Mat> &backProjects, const cv::Range &rows) {
+
+    CV_Assert(hsv.type() == CV_8UC3);
+
+    // Bin counts are those the histograms were trained with, which must all match
+    int hbins = 0, sbins = 0;
+    for (size_t i = 0; i < hsv_hists.size(); i++) {
+        if (hsv_hists[i].data) {
+            CV_Assert(hsv_hists[i].dims == 2 && (hbins == 0 || (hsv_hists[i].size[0] == hbins && hsv_hists[i].size[1] == sbins)));
+            hbins = hsv_hists[i].size[0];
+            sbins = hsv_hists[i].size[1];
+        }
+    }
+
+    int h_lookup[256];
+    int s_lookup[256];
+    buildBinLookup(h_ranges, hbins, h_lookup);
+    buildBinLookup(s_ranges, sbins, s_lookup);
+
+    // Combined (H, S) bin for every pair of channel values; the extra bin past the end is the out of range bin
+    const int outOfRange = hbins * sbins;
+    int hBin[256];
+    int sBin[256];
+    for (int v = 0; v < 256; v++) {
+        hBin[v] = h_lookup[v] < 0 ? -1 : h_lookup[v] * sbins;
+        sBin[v] = s_lookup[v];
+    }
+
+    // Saturate each histogram to 8-bit once, instead of once per pixel. A handful of targets fit on the stack.
+    const size_t targets = hsv_hists.size();
+    const size_t binCount = outOfRange + 1;
+    cv::AutoBuffer<uchar, 1 << 14> binValues(targets * binCount);
+    std::fill((uchar*)binValues, (uchar*)binValues + targets * binCount, 0);
+    for (size_t i = 0; i < targets; i++) {
+        if (!hsv_hists[i].data) {
+            continue;
+        }
+        CV_Assert(hsv_hists[i].type() == CV_32F && hsv_hists[i].isContinuous() && hsv_hists[i].total() == (size_t)outOfRange);
+        const float *hist = hsv_hists[i].ptr<float>();
+        uchar *values = binValues + i * binCount;
+        for (int bin = 0; bin < outOfRange; bin++) {
+            values[bin] = cv::saturate_cast<uchar>(hist[bin]);
+        }
+    }
+
+    // Single pass over the pixels, computing each pixel's bin once for every target
+    cv::AutoBuffer<uchar*, 16> dst(targets);
+    for (int y = rows.start; y < rows.end; y++) {
+        const uchar *src = hsv.ptr<uchar>(y);
+        for (size_t i = 0; i < targets; i++) {
+            dst[i] = backProjects[i].ptr<uchar>(y);
+        }
+        for (int x = 0; x < hsv.cols; x++, src += 3) {
+            int h = hBin[src[0]];
+            int s = sBin[src[1]];
+            int bin = (h < 0 || s < 0) ? outOfRange : h + s;
+            for (size_t i = 0; i < targets; i++) {
+                dst[i][x] = binValues[i * binCount + bin];
+            }
+        }
+    }
+
+}
+
+void backProjectTargets(const cv::Mat &hsv, const vector<cv::MatND> &hsv_hists, vector<cv::Mat> &backProjects) {
+
+    backProjects.resize(hsv_hists.size());
+    for (size_t i = 0; i < hsv_hists.size(); i++) {
+        backProjects[i].create(hsv.size(), CV_8UC1);
+    }
+    backProjectTargetRows(hsv, hsv_hists, backProjects, cv::Range(0, hsv.rows));
+
+}
+
+// Track a target in part of the frame, given the back projection of that part
+static void trackInRegion(const cv::Mat &backProject, cv::Point offset, TrackResult &result, TargetWorkspace &workspace) {
+
+    cv::Mat region = bufferView(workspace.region, backProject.size(), CV_8UC1, workspace.allocations);
+    regionMarkBackProject(backProject, region, workspace);
+
+    BlobStats blob;
+    if (!findLargestBlob(region, blob, workspace)) {
+        result = TrackResult();
+        return;
+    }
+    cv::Rect box = blob.box();
+    result.size = box.size();
+    result.point = cv::Point(box.x + box.width / 2, box.y + box.height / 2) + offset;
+    result.centroid = blob.centroid() + cv::Point2f(offset);
+    result.radius = blob.radius();
+
+}
+
+// Move a tracking result found in part of the frame into frame coordinates
+static void offsetResult(TrackResult &result, cv::Point offset) {
+
+    if (result.size.area() > 0) {
+        result.point += offset;
+        result.centroid += cv::Point2f(offset);
+    }
+
+}
+
+// Bounding box of a tracking result
+static cv::Rect resultBox(const TrackResult &result) {
+
+    return cv::Rect(result.point.x - result.size.width / 2, result.point.y - result.size.height / 2, result.size.width, result.size.height);
+
+}
+
+// Back project an image for the given targets, through their lookup tables when there are
+// any, or else through a single HSV conversion shared by all of them. Each target's back
+// projection goes to its workspace buffer, the refine buffer when refining.
+static void backProjectSelected(const cv::Mat &image, const vector<cv::MatND> &hsv_hists, const vector<BackProjectLUT> *luts, const size_t *targets, size_t count,
+    bool refine, TrackerWorkspace &workspace) {
+
+    vector<cv::Mat> &backProjects = workspace.backProjects;
+    backProjects.clear();
+    for (size_t i = 0; i < count; i++) {
+        TargetWorkspace &target = workspace.targets[targets[i]];
+        backProjects.push_back(bufferView(refine ? target.refineBackProject : target.backProject, image.size(), CV_8UC1, target.allocations));
+    }
+
+    // Frames in the camera's layout can only be looked up
+    CV_Assert(luts || image.type() == CV_8UC3);
+
+    const int stripes = stripeCount(image.rows, workspace.stripes);
+    if (luts) {
+        workspace.luts.clear();
+        for (size_t i = 0; i < count; i++) {
+            workspace.luts.push_back(&(*luts)[targets[i]]);
+        }
+        if (stripes > 1) {
+            ScopedStageTimer timer(workspace.profiler, STAGE_BACKPROJECT);
+            forEachStripe(image.rows, stripes, [&](int, const cv::Range &rows) {
+                backProjectLUTRows(image, workspace.luts, backProjects, rows);
+            });
+        } else {
+            ScopedStageTimer timer(workspace.profiler, STAGE_BACKPROJECT);
+            backProjectLUT(image, workspace.luts, backProjects);
+        }
+        return;
+    }
+
+    workspace.hists.clear();
+    for (size_t i = 0; i < count; i++) {
+        workspace.hists.push_back(hsv_hists[targets[i]]);
+    }
+    cv::Mat hsv = bufferView(workspace.hsv, image.size(), CV_8UC3, workspace.allocations);
+    if (stripes > 1) {
+        // Convert and back project each stripe while it is still in cache
+        ScopedStageTimer timer(workspace.profiler, STAGE_BACKPROJECT);
+        forEachStripe(image.rows, stripes, [&](int, const cv::Range &rows) {
+            cv::Mat hsvRows = hsv.rowRange(rows);
+            cv::cvtColor(image.rowRange(rows), hsvRows, CV_RGB2HSV);
+            backProjectTargetRows(hsv, workspace.hists, backProjects, rows);
+        });
+    } else {
+        convertToHsv(image, hsv, workspace.profiler);
+        ScopedStageTimer timer(workspace.profiler, STAGE_BACKPROJECT);
+        backProjectTargets(hsv, workspace.hists, backProjects);
+    }
+
+}
+
+// Full frame detection of the given targets. Above pyramid level 0 the frame is searched at
+// 1 / 2^level resolution, and each target is then refined at full resolution in a small window.
+static void detectTargets(const cv::Mat &frame, const vector<cv::MatND> &hsv_hists, const vector<BackProjectLUT> *luts, const vector<size_t> &targets, int pyramidLevel,
+    vector<TrackResult> &results, TrackerWorkspace &workspace) {
+
+    if (targets.empty()) {
+        return;
+    }
+
+    // Shrinking a YUYV frame would blend luma into chroma, so it is searched at full resolution
+    if (frame.type() != CV_8UC3) {
+        pyramidLevel = 0;
+    }
+
+    cv::Mat searched;
+    if (pyramidLevel > 0) {
+        cv::Size size(frame.cols >> pyramidLevel, frame.rows >> pyramidLevel);
+        searched = bufferView(workspace.searched, size, CV_8UC3, workspace.allocations);
+        cv::resize(frame, searched, size, 0, 0, cv::INTER_AREA);
+    } else {
+        searched = frame;
+    }
+
+    // Back project every target in the same pass
+    backProjectSelected(searched, hsv_hists, luts, &targets[0], targets.size(), false, workspace);
+
+    // Targets are independent from here, each with its own workspace
+    forEachTarget(targets.size(), workspace.stripes > 1, [&](size_t i) {
+        trackInRegion(workspace.backProjects[i], cv::Point(0, 0), results[targets[i]], workspace.targets[targets[i]]);
+    });
+    if (pyramidLevel == 0) {
+        return;
+    }
+
+    const cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+    for (size_t i = 0; i < targets.size(); i++) {
+        TargetWorkspace &target = workspace.targets[targets[i]];
+        TrackResult &result = results[targets[i]];
+        if (result.size.area() == 0) {
+            continue;
+        }
+
+        // Scale the coarse box back up, and refine it at full resolution
+        const int scale = 1 << pyramidLevel;
+        cv::Rect box = resultBox(result);
+        cv::Rect refine = cv::Rect((box.x - 2) * scale, (box.y - 2) * scale, (box.width + 4) * scale, (box.height + 4) * scale) & frameRect;
+        backProjectSelected(frame(refine), hsv_hists, luts, &targets[i], 1, true, workspace);
+        trackInRegion(workspace.backProjects[0], refine.tl(), result, target);
+    }
+
+}
+
+void updateTracksAndSizes(const cv::Mat &frame, const vector<cv::MatND> &hsv_hists, vector<TrackResult> &results, int pyramidLevel, const vector<BackProjectLUT> *luts,
+    TrackerWorkspace *workspace, MotionGate *gate) {
+
+    TrackerWorkspace local;
+    if (!workspace) {
+        workspace = &local;
+        workspace->reserve(frame.size(), hsv_hists.size());
+    }
+
+    results.resize(hsv_hists.size());
+
+    const cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+    vector<size_t> &targets = workspace->detect;
+    targets.clear();
+    for (size_t i = 0; i < hsv_hists.size(); i++) {
+        if (!hsv_hists[i].data) {
+            results[i] = TrackResult();
+        } else if (!gate || gate->admit(frameRect)) {
+            results[i] = TrackResult();
+            targets.push_back(i);
+        }
+    }
+
+    detectTargets(frame, hsv_hists, luts, targets, pyramidLevel, results, *workspace);
+
+}
+
+// Whether the target found in a window can be trusted, or a full frame scan is needed
+static bool confidentInWindow(const TrackWindow &window, const TrackResult &result, const cv::Rect &frameRect) {
+
+    int area = result.size.area();
+    if (area == 0 || area < window.lastArea * minAreaRatio) {
+        return false;
+    }
+
+    // A box clipped by the window, rather than by the frame, may be leaving the window
+    cv::Rect box = resultBox(result);
+    const cv::Rect &w = window.window;
+    if ((box.x <= w.x && w.x > frameRect.x) || (box.y <= w.y && w.y > frameRect.y)
+        || (box.x + box.width >= w.x + w.width && w.x + w.width < frameRect.width)
+        || (box.y + box.height >= w.y + w.height && w.y + w.height < frameRect.height)) {
+        return false;
+    }
+
+    return true;
+
+}
+
+// Centre the search window on the latest result, or unlock it if the target was lost
+static void updateWindow(TrackWindow &window, const TrackResult &result, const cv::Rect &frameRect) {
+
+    int area = result.size.area();
+    if (area == 0) {
+        window = TrackWindow();
+        return;
+    }
+
+    cv::Rect box = resultBox(result);
+    int margin = std::max(box.width, box.height) / 2 + searchMargin;
+    window.window = cv::Rect(box.x - margin, box.y - margin, box.width + 2 * margin, box.height + 2 * margin) & frameRect;
+    bool steady = window.locked && std::abs(area - window.lastArea) <= window.lastArea * stableAreaRatio;
+    window.stableFrames = steady ? window.stableFrames + 1 : 0;
+    window.lastArea = area;
+    window.locked = true;
+
+}
+
+void updateTracksAndSizes(const cv::Mat &frame, const vector<cv::MatND> &hsv_hists, vector<TrackResult> &results, vector<TrackWindow> &windows, int pyramidLevel,
+    const vector<BackProjectLUT> *luts, TrackerWorkspace *workspace, MotionGate *gate) {
+
+    TrackerWorkspace local;
+    if (!workspace) {
+        workspace = &local;
+        workspace->reserve(frame.size(), hsv_hists.size());
+    }
+
+    const cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+    results.resize(hsv_hists.size());
+    windows.resize(hsv_hists.size());
+
+    // Only the union of the locked targets' windows needs converting
+    vector<size_t> &locked = workspace->locked;
+    vector<size_t> &lost = workspace->lost;
+    locked.clear();
+    lost.clear();
+    cv::Rect scan;
+    for (size_t i = 0; i < hsv_hists.size(); i++) {
+        if (!hsv_hists[i].data) {
+            results[i] = TrackResult();
+            windows[i] = TrackWindow();
+        } else if (gate && !gate->admit(windows[i].locked ? windows[i].window : frameRect)) {
+            // Nothing moved where the target was, or anywhere it was last searched for
+            continue;
+        } else if (windows[i].locked) {
+            locked.push_back(i);
+            scan = scan.area() == 0 ? windows[i].window : (scan | windows[i].window);
+        } else {
+            lost.push_back(i);
+        }
+    }
+
+    if (!locked.empty()) {
+        backProjectSelected(frame(scan), hsv_hists, luts, &locked[0], locked.size(), false, *workspace);
+
+        forEachTarget(locked.size(), workspace->stripes > 1, [&](size_t i) {
+            const TrackWindow &window = windows[locked[i]];
+            trackInRegion(workspace->backProjects[i](window.window - scan.tl()), window.window.tl(), results[locked[i]], workspace->targets[locked[i]]);
+        });
+
+        // Targets lost inside their window fall back to a full frame scan
+        for (size_t i = 0; i < locked.size(); i++) {
+            if (!confidentInWindow(windows[locked[i]], results[locked[i]], frameRect)) {
+                lost.push_back(locked[i]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < lost.size(); i++) {
+        results[lost[i]] = TrackResult();
+    }
+
+    // A lost target can only have turned up where something moved
+    const cv::Rect detectArea = gate ? gate->getMovingBounds() : frameRect;
+    if (detectArea.area() > 0) {
+        detectTargets(frame(detectArea), hsv_hists, luts, lost, pyramidLevel, results, *workspace);
+        for (size_t i = 0; i < lost.size(); i++) {
+            offsetResult(results[lost[i]], detectArea.tl());
+        }
+    }
+
+    for (size_t i = 0; i < hsv_hists.size(); i++) {
+        if (hsv_hists[i].data) {
+            updateWindow(windows[i], results[i], frameRect);
+        }
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Mirror the found targets left to right. Mirroring twice gives back the same results.
+//--------------------------------------------------------------------------------------
+void mirrorResults(vector<TrackResult> &results, int width) {
+
+    for (size_t i = 0; i < results.size(); i++) {
+        TrackResult &result = results[i];
+        if (result.size.area() > 0) {
+            result.point.x = width - 1 - result.point.x;
+            result.centroid.x = width - 1 - result.centroid.x;
+        }
+    }
+
+}
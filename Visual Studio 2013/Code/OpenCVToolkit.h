@@ -1,11 +1,13 @@
+#pragma once
+
 #include <opencv2\imgproc\imgproc.hpp>
 #include <opencv2\highgui\highgui.hpp>
 #include <opencv2\opencv.hpp>
 
-using namespace std;
+#include "BitMask.h"
+#include "TrackerParams.h"
 
-extern cv::Mat frame;
-extern cv::VideoCapture webcam;
+using namespace std;
 
 extern bool stop;
 extern int delay; //ms
@@ -42,6 +44,133 @@ extern const int thre;
 // Flood fill local tolerance
 extern const int tolerance;
 
+// Windowed search setting
+// Pixels searched around the last bounding box, on top of half the box size
+extern const int searchMargin;
+// Fraction of the last area below which the target counts as lost
+extern const float minAreaRatio;
+
+// Tracking result for a single target
+struct TrackResult {
+    cv::Point point;
+    cv::Size size;
+    cv::Point2f centroid;       // Centre of mass of the target's pixels
+    float radius = 0.f;         // Radius of a disc with the target's area, 0 when it wasn't found
+    double timestamp = 0.0;     // Capture time of the frame, in seconds
+};
+
+// Area the game judges a target's depth by: that of the square around a disc of the target's
+// area. For a ball this is its bounding box area, without the noise along the box edges.
+inline float depthArea(const TrackResult &result) { return 4.f * result.radius * result.radius; }
+
+// Search window carried between frames for a single target
+struct TrackWindow {
+    cv::Rect window;
+    int lastArea = 0;
+    bool locked = false;
+    int stableFrames = 0;       // Frames in a row the area has stayed close to the frame before's
+};
+
+class BackProjectLUT;
+class MotionGate;
+class PipelineProfiler;
+
+// Intermediate images and buffers of the region stages for a single target
+struct TargetWorkspace {
+    cv::Mat backProject;
+    cv::Mat refineBackProject;
+    cv::Mat region;
+    vector<int> labels;
+    vector<int> parent;
+    vector<int> index;
+    vector<int> stripeFirstLabel;
+    vector<int> stripeLabelCount;
+    BitMask mask;
+    BitMask maskScratch;
+    vector<MaskRun> runs;
+    vector<BlobStats> blobs;
+    IncrementalBlobs incrementalBlobs;
+
+    // Horizontal stripes each stage is split into on the thread pool, 1 to run serially
+    int stripes = 1;
+    TrackerParams params;
+    // Label only the bands of the mask that changed since the last frame
+    bool incremental = false;
+    PipelineProfiler *profiler = nullptr;
+
+    // Buffers that had to grow while tracking
+    unsigned long allocations = 0;
+};
+
+// Intermediate images and buffers for tracking, allocated once for the frame size and reused
+// every frame. Each stage works on a view of its buffer at the size it needs.
+struct TrackerWorkspace {
+    cv::Mat searched;
+    cv::Mat hsv;
+    vector<TargetWorkspace> targets;
+
+    // Thresholds and kernel sizes every target is tracked with
+    TrackerParams params;
+
+    // Per-frame lists of targets and the back projections being worked on
+    vector<size_t> detect;
+    vector<size_t> locked;
+    vector<size_t> lost;
+    vector<cv::MatND> hists;
+    vector<const BackProjectLUT*> luts;
+    vector<cv::Mat> backProjects;
+
+    // Horizontal stripes each stage is split into on the thread pool, 1 to run serially. With
+    // more than one, independent targets are also tracked concurrently.
+    int stripes = 1;
+
+    // Keep each target's blobs from frame to frame, labelling only the bands of its mask that
+    // changed, unless more than maxDirtyRatio of them did. This pays off while the searched area
+    // stays put, as it does for full frame searches at pyramid level 0.
+    bool incremental = false;
+    float maxDirtyRatio = 0.25f;
+
+    // Profiler the stages report their timings to, or null while profiling is off. Each tracker
+    // has its own, so trackers on different threads never share one.
+    PipelineProfiler *profiler = nullptr;
+
+    unsigned long allocations = 0;
+
+    // Size every buffer for frames of the given size, so tracking them allocates nothing
+    void reserve(cv::Size size, size_t targetCount);
+    // Buffers that had to grow since they were reserved, which should stay at zero
+    unsigned long allocationCount() const;
+};
+
 extern void regionMark(const cv::Mat &frame, const cv::MatND &hsv_hist, cv::Mat &markMap);
+extern void regionMarkBackProject(const cv::Mat &backProject, cv::Mat &markMap);
+extern void regionMarkBackProject(const cv::Mat &backProject, cv::Mat &markMap, TargetWorkspace &workspace);
+// Label the 4-connected regions above thre in place, with the same numbering the flood fill loop produced
+extern void labelRegions(cv::Mat &markMap);
+extern void labelRegions(cv::Mat &markMap, TargetWorkspace &workspace);
+
+// Pyramid level 1 or 2 detects on a 1/2 or 1/4 size frame, then refines at full resolution
+extern void updateTrackAndSize(const cv::Mat &frame, const cv::MatND &hsv_hist, cv::Point &point, cv::Size &size, int pyramidLevel = 0);
+extern void findLargestRegion(const cv::Mat &region, cv::Point &point, cv::Size &size);
+extern void findLargestRegion(const cv::Mat &region, cv::Point &point, cv::Size &size, TargetWorkspace &workspace);
+extern bool findLargestBlob(const cv::Mat &region, BlobStats &blob, TargetWorkspace &workspace);
+
+// Histogram bin of every 8-bit channel value, as calcBackProject bins it, or -1 outside the range
+extern void buildBinLookup(const float *range, int bins, int *lookup);
+
+// Multi-target tracking, sharing a single HSV conversion and back projection pass between all histograms.
+// Given lookup tables baked from the histograms, one per target, the frame is back projected through them instead.
+// Given a workspace, its buffers are used in place of allocating new ones.
+// Given a motion gate already updated with the frame, targets are only searched for where it saw motion, and
+// keep their results from the last frame otherwise.
+// YUYV frames (CV_8UC2) are only tracked through lookup tables baked for YUYV, always at pyramid level 0.
+extern void backProjectTargets(const cv::Mat &hsv, const vector<cv::MatND> &hsv_hists, vector<cv::Mat> &backProjects);
+extern void updateTracksAndSizes(const cv::Mat &frame, const vector<cv::MatND> &hsv_hists, vector<TrackResult> &results, int pyramidLevel = 0,
+    const vector<BackProjectLUT> *luts = nullptr, TrackerWorkspace *workspace = nullptr, MotionGate *gate = nullptr);
+// As above, but only searching a window around each target's last position while it stays locked on
+extern void updateTracksAndSizes(const cv::Mat &frame, const vector<cv::MatND> &hsv_hists, vector<TrackResult> &results, vector<TrackWindow> &windows, int pyramidLevel = 0,
+    const vector<BackProjectLUT> *luts = nullptr, TrackerWorkspace *workspace = nullptr, MotionGate *gate = nullptr);
 
-extern void updateTrackAndSize(const cv::Mat &frame, const cv::MatND &hsv_hist, cv::Point &point, cv::Size &size);
+// Mirror tracking results left to right across a frame of the given width. YUYV frames are borrowed from the
+// camera, so are tracked as they are and only their results mirrored, rather than copied into a mirrored frame.
+extern void mirrorResults(vector<TrackResult> &results, int width);
@@ -0,0 +1,116 @@
+//--------------------------------------------------------------------------------------
+// File: PipelineProfiler.cpp
+//
+// This file contains the implementations for timing the stages of the tracking pipeline
+//--------------------------------------------------------------------------------------
+
+#include <fstream>
+
+#include "PipelineProfiler.h"
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+PipelineProfiler::PipelineProfiler(int window) {
+
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        samples[i].times.resize(std::max(window, 1));
+        samples[i].next = 0;
+        samples[i].count = 0;
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Add a stage timing, replacing the oldest once the window is full
+//--------------------------------------------------------------------------------------
+void PipelineProfiler::record(PipelineStage stage, double ms) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Samples &s = samples[stage];
+    s.times[s.next] = ms;
+    s.next = (s.next + 1) % s.times.size();
+    s.count = std::min(s.count + 1, s.times.size());
+
+}
+
+//--------------------------------------------------------------------------------------
+// Forget all timings
+//--------------------------------------------------------------------------------------
+void PipelineProfiler::reset() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        samples[i].next = 0;
+        samples[i].count = 0;
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Statistics over the timings currently in a stage's window
+//--------------------------------------------------------------------------------------
+StageStats PipelineProfiler::getStats(PipelineStage stage) {
+
+    vector<double> times;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const Samples &s = samples[stage];
+        times.assign(s.times.begin(), s.times.begin() + s.count);
+    }
+
+    StageStats stats;
+    stats.samples = (int)times.size();
+    if (times.empty()) {
+        return stats;
+    }
+
+    double total = 0.0;
+    for (size_t i = 0; i < times.size(); i++) {
+        total += times[i];
+    }
+    stats.mean = total / times.size();
+    stats.min = *std::min_element(times.begin(), times.end());
+
+    // Nearest rank percentiles
+    size_t p95 = std::min(times.size() - 1, (size_t)std::ceil(times.size() * 0.95) - 1);
+    std::nth_element(times.begin(), times.begin() + p95, times.end());
+    stats.p95 = times[p95];
+    size_t p99 = std::min(times.size() - 1, (size_t)std::ceil(times.size() * 0.99) - 1);
+    std::nth_element(times.begin() + p95, times.begin() + p99, times.end());
+    stats.p99 = times[p99];
+
+    return stats;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Write the statistics of every stage to a CSV file
+//--------------------------------------------------------------------------------------
+bool PipelineProfiler::writeCsv(const std::string &path) {
+
+    std::ofstream csv(path.c_str());
+    if (!csv.is_open()) {
+        std::cout << "unable to open " << path << std::endl;
+        return false;
+    }
+
+    csv << "stage,samples,min_ms,mean_ms,p95_ms,p99_ms" << std::endl;
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        StageStats stats = getStats((PipelineStage)i);
+        csv << stageName((PipelineStage)i) << "," << stats.samples << "," << stats.min << ","
+            << stats.mean << "," << stats.p95 << "," << stats.p99 << std::endl;
+    }
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Name of a stage, for reports
+//--------------------------------------------------------------------------------------
+const char *PipelineProfiler::stageName(PipelineStage stage) {
+
+    static const char *names[STAGE_COUNT] = { "convert", "backproject", "denoise", "threshold", "label", "open", "blobs", "largest" };
+    return stage < STAGE_COUNT ? names[stage] : "unknown";
+
+}
@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// File: PipelineProfiler.h
+//
+// This file contains the definitions for timing the stages of the tracking pipeline
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <mutex>
+
+#include "OpenCVToolkit.h"
+
+//--------------------------------------------------------------------------------------
+// Timed stages of the tracking pipeline
+//--------------------------------------------------------------------------------------
+enum PipelineStage {
+    STAGE_CONVERT,          // Colour conversion to HSV
+    STAGE_BACKPROJECT,      // Histogram back projection
+    STAGE_DENOISE,          // Open and threshold of the back projection to the region map
+    STAGE_THRESHOLD,        // Thresholding of the region map to a bit mask
+    STAGE_LABEL,            // Region labelling
+    STAGE_OPEN,             // Open of the bit mask
+    STAGE_BLOBS,            // Run labelling of the opened mask, with blob stats
+    STAGE_LARGEST,          // Largest blob scan
+    STAGE_COUNT
+};
+
+//--------------------------------------------------------------------------------------
+// Rolling statistics for a single stage, in milliseconds
+//--------------------------------------------------------------------------------------
+struct StageStats {
+    int samples = 0;
+    double min = 0.0;
+    double mean = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+};
+
+//--------------------------------------------------------------------------------------
+// Keeps the most recent timings of every stage, to report rolling statistics from
+//--------------------------------------------------------------------------------------
+class PipelineProfiler {
+public:
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    PipelineProfiler(int window = 300);
+
+    void record(PipelineStage stage, double ms);
+    void reset();
+
+    StageStats getStats(PipelineStage stage);
+    bool writeCsv(const std::string &path);
+
+    static const char *stageName(PipelineStage stage);
+
+private:
+    //--------------------------------------------------------------------------------------
+    // Variables
+    //--------------------------------------------------------------------------------------
+
+    // Ring buffer of the last window timings per stage
+    struct Samples {
+        vector<double> times;
+        size_t next;
+        size_t count;
+    };
+
+    Samples samples[STAGE_COUNT];
+    std::mutex mutex;
+};
+
+//--------------------------------------------------------------------------------------
+// Times the enclosing scope as a pipeline stage, reporting to the profiler of the workspace
+// being tracked with. Costs a single pointer check while profiling is off.
+//--------------------------------------------------------------------------------------
+class ScopedStageTimer {
+public:
+    ScopedStageTimer(PipelineProfiler *profiler, PipelineStage stage) : stage(stage), profiler(profiler), start(profiler ? cv::getTickCount() : 0) {};
+    ~ScopedStageTimer() {
+        if (profiler) {
+            profiler->record(stage, (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency());
+        }
+    };
+
+private:
+    PipelineStage stage;
+    PipelineProfiler *profiler;
+    int64 start;
+};
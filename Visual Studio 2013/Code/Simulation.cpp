@@ -0,0 +1,231 @@
+//--------------------------------------------------------------------------------------
+// File: Simulation.cpp
+//
+// This file contains the implementations for the game rules, stepped at a fixed rate apart
+// from rendering
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+
+#include "Simulation.h"
+
+// Stereo depth, with the calibration in metres. A glove stereoReach from the cameras is at the
+// near plane, and moves stereoDepthScale units into the scene for every metre closer.
+static const float stereoReach = 1.5f;
+static const float stereoScale = 8.f;
+static const float stereoDepthScale = 20.f;
+
+// Gloves are never drawn nearer than the near plane
+static const float nearestGlove = 4.f;
+
+Vec3 lerp(const Vec3 &from, const Vec3 &to, float alpha) {
+
+    return Vec3(from.x + (to.x - from.x) * alpha, from.y + (to.y - from.y) * alpha, from.z + (to.z - from.z) * alpha);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Glove mapping from tracker coordinates
+//--------------------------------------------------------------------------------------
+Vec3 gloveFromCamera(float x, float y, float size, int frameWidth, int frameHeight) {
+
+    return Vec3((x - (frameWidth / 2.f)) / 50.f, -(y - (frameHeight / 2.f)) / 50.f, std::max(size / 200.f, nearestGlove));
+
+}
+
+Vec3 gloveFromStereo(float x, float y, float z) {
+
+    return Vec3(-x * stereoScale, -y * stereoScale, std::max(nearestGlove + (stereoReach - z) * stereoDepthScale, nearestGlove));
+
+}
+
+//--------------------------------------------------------------------------------------
+// Random numbers
+//--------------------------------------------------------------------------------------
+void GameRandom::reseed(uint64_t seed) {
+
+    // Spread the seed with a splitmix64 step, so nearby seeds start far apart and none is zero
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    state = z != 0 ? z : 0x9E3779B97F4A7C15ULL;
+
+}
+
+uint32_t GameRandom::next() {
+
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (uint32_t)((state * 0x2545F4914F6CDD1DULL) >> 32);
+
+}
+
+float GameRandom::uniform(float lower, float upper) {
+
+    // 24 bits fill a float's mantissa exactly
+    float unit = (next() >> 8) * (1.f / 16777216.f);
+    return lower + unit * (upper - lower);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+Simulation::Simulation(uint64_t seed, const GameRules &rules, double timestep, int maxSteps)
+    : rules(rules), timestep(timestep), maxSteps(maxSteps), accumulator(0.0) {
+
+    reset(seed);
+    startRound();
+    previous = state;
+
+}
+
+void Simulation::reset(uint64_t seed) {
+
+    random.reseed(seed);
+    accumulator = 0.0;
+    state = GameState();
+    previous = state;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Advance the game by one timestep
+//--------------------------------------------------------------------------------------
+unsigned Simulation::step(const GameInput &input) {
+
+    previous = state;
+    unsigned events = 0;
+
+    if (state.playing) {
+        for (int i = 0; i < GLOVE_COUNT; i++) {
+            state.gloves[i] = input.gloves[i];
+        }
+
+        // If you hit the target, reset its position and give yourself some points. Each glove
+        // gets the slack of however its position was found this step.
+        for (int i = 0; i < GLOVE_COUNT; i++) {
+            const Vec3 &gloveBounds = input.triangulated[i] ? rules.stereoGloveBounds : rules.gloveBounds;
+            const Vec3 &targetBounds = input.triangulated[i] ? rules.stereoTargetBounds : rules.targetBounds;
+            if (isColliding(state.gloves[i], gloveBounds, state.target, targetBounds)) {
+                scorePoint();
+                spawnTarget();
+                events |= EVENT_HIT;
+                break;
+            }
+        }
+
+        state.gameTime -= (float)timestep;
+        if (state.gameTime <= 0.f) {
+            state.gameTime = 0.f;
+            state.playing = false;
+            events |= EVENT_END;
+        }
+    } else if (input.start) {
+        startRound();
+        events |= EVENT_START;
+    }
+
+    state.step++;
+    return events;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Step through the real time passed. A slow frame drops what it can't catch up on, rather
+// than spending the next frame catching up.
+//--------------------------------------------------------------------------------------
+unsigned Simulation::advance(double elapsed, const GameInput &input) {
+
+    unsigned events = 0;
+    accumulator += elapsed;
+    int steps = 0;
+    while (accumulator >= timestep && steps < maxSteps) {
+        events |= step(input);
+        accumulator -= timestep;
+        steps++;
+    }
+    accumulator = std::min(accumulator, timestep);
+    return events;
+
+}
+
+//--------------------------------------------------------------------------------------
+// State at the real time between the last two steps. Targets and the clock jump when hit,
+// so only the gloves and a running clock are blended.
+//--------------------------------------------------------------------------------------
+GameState Simulation::interpolate() const {
+
+    float alpha = (float)std::min(accumulator / timestep, 1.0);
+    GameState blended = state;
+    for (int i = 0; i < GLOVE_COUNT; i++) {
+        blended.gloves[i] = lerp(previous.gloves[i], state.gloves[i], alpha);
+    }
+    if (previous.playing && state.playing && previous.hits == state.hits) {
+        blended.gameTime = previous.gameTime + (state.gameTime - previous.gameTime) * alpha;
+    }
+    return blended;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Returns whether or not two objects are colliding, which is when either corner of the
+// first one's box is inside the second one's
+//--------------------------------------------------------------------------------------
+bool Simulation::isColliding(const Vec3 &obj1, const Vec3 &obj1bounds, const Vec3 &obj2, const Vec3 &obj2bounds) {
+
+    // Calculate the minimum and maximum points for both objects bounding boxes
+    Vec3 vMin1(obj1.x - obj1bounds.x / 2.f, obj1.y - obj1bounds.y / 2.f, obj1.z - obj1bounds.z / 2.f);
+    Vec3 vMax1(obj1.x + obj1bounds.x / 2.f, obj1.y + obj1bounds.y / 2.f, obj1.z + obj1bounds.z / 2.f);
+    Vec3 vMin2(obj2.x - obj2bounds.x / 2.f, obj2.y - obj2bounds.y / 2.f, obj2.z - obj2bounds.z / 2.f);
+    Vec3 vMax2(obj2.x + obj2bounds.x / 2.f, obj2.y + obj2bounds.y / 2.f, obj2.z + obj2bounds.z / 2.f);
+
+    if (vMin1.x > vMin2.x && vMin1.x < vMax2.x && vMin1.y > vMin2.y && vMin1.y < vMax2.y && vMin1.z > vMin2.z && vMin1.z < vMax2.z) {
+        return true;
+    }
+
+    if (vMax1.x > vMin2.x && vMax1.x < vMax2.x && vMax1.y > vMin2.y && vMax1.y < vMax2.y && vMax1.z > vMin2.z && vMax1.z < vMax2.z) {
+        return true;
+    }
+
+    return false;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Start a round with a full clock and a fresh target
+//--------------------------------------------------------------------------------------
+void Simulation::startRound() {
+
+    state.playing = true;
+    state.score = 0;
+    state.hits = 0;
+    state.gameTime = rules.roundTime;
+    state.nextGameTime = rules.firstHitTime;
+    spawnTarget();
+
+}
+
+//--------------------------------------------------------------------------------------
+// Update player score and set the updated score timer
+//--------------------------------------------------------------------------------------
+void Simulation::scorePoint() {
+
+    state.score += (int)(state.gameTime * 10.f);
+    state.hits++;
+    state.gameTime = state.nextGameTime;
+    state.nextGameTime -= state.nextGameTime / 10.f;
+
+}
+
+void Simulation::spawnTarget() {
+
+    // Drawn in a fixed order, so a seed gives the same targets everywhere
+    float x = random.uniform(rules.targetMin.x, rules.targetMax.x);
+    float y = random.uniform(rules.targetMin.y, rules.targetMax.y);
+    float z = random.uniform(rules.targetMin.z, rules.targetMax.z);
+    state.target = Vec3(x, y, z);
+
+}
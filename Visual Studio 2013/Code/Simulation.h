@@ -0,0 +1,150 @@
+//--------------------------------------------------------------------------------------
+// File: Simulation.h
+//
+// This file contains the definitions for the game rules, stepped at a fixed rate apart
+// from rendering
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+//--------------------------------------------------------------------------------------
+// Position or size in game units. The camera looks down +z from the origin.
+//--------------------------------------------------------------------------------------
+struct Vec3 {
+    float x, y, z;
+
+    Vec3() : x(0.f), y(0.f), z(0.f) {};
+    Vec3(float x, float y, float z) : x(x), y(y), z(z) {};
+};
+
+extern Vec3 lerp(const Vec3 &from, const Vec3 &to, float alpha);
+
+//--------------------------------------------------------------------------------------
+// Where a glove is in the game, from where the tracker sees it
+//--------------------------------------------------------------------------------------
+
+// From a ball at a pixel of the mirrored camera frame, with its depth guessed from its size
+extern Vec3 gloveFromCamera(float x, float y, float size, int frameWidth, int frameHeight);
+// From a triangulated position in metres, in the left camera's frame. The player faces the
+// cameras, so the camera's x is mirrored and its y points down.
+extern Vec3 gloveFromStereo(float x, float y, float z);
+
+//--------------------------------------------------------------------------------------
+// Seeded xorshift64* generator, giving the same targets for the same seed on every platform,
+// where rand() and the std distributions are up to the library
+//--------------------------------------------------------------------------------------
+class GameRandom {
+public:
+    explicit GameRandom(uint64_t seed = 1) { reseed(seed); };
+
+    void reseed(uint64_t seed);
+    uint32_t next();
+    // Uniform in [lower, upper)
+    float uniform(float lower, float upper);
+
+private:
+    uint64_t state;
+};
+
+//--------------------------------------------------------------------------------------
+// Rules of a round, which can be changed between rounds when balancing
+//--------------------------------------------------------------------------------------
+struct GameRules {
+    float roundTime = 10.f;             // s on the clock when a round starts
+    float firstHitTime = 9.f;           // s the clock is set to by the first hit, each hit after a tenth less
+    Vec3 targetMin = Vec3(-5.f, -2.f, 10.f);    // Box targets appear in
+    Vec3 targetMax = Vec3(5.f, 2.f, 25.f);
+    Vec3 gloveBounds = Vec3(1.f, 1.f, 1.f);
+    Vec3 targetBounds = Vec3(1.5f, 1.5f, 1.f);
+    // Bounds for gloves triangulated by both cameras, as measured depth needs less slack than
+    // depth guessed from the ball's size
+    Vec3 stereoGloveBounds = Vec3(0.75f, 0.75f, 0.75f);
+    Vec3 stereoTargetBounds = Vec3(1.25f, 1.25f, 1.f);
+};
+
+//--------------------------------------------------------------------------------------
+// What the player does during a step
+//--------------------------------------------------------------------------------------
+enum GloveIndex { GLOVE_RED, GLOVE_GREEN, GLOVE_COUNT };
+
+struct GameInput {
+    Vec3 gloves[GLOVE_COUNT];
+    bool triangulated[GLOVE_COUNT];     // Glove measured by both cameras this step, rather than guessed from one
+    bool start = false;                 // Start a round, if none is being played
+
+    GameInput() { std::fill(triangulated, triangulated + GLOVE_COUNT, false); };
+};
+
+// Things that happened during a step, for sounds and statistics
+enum GameEvent { EVENT_START = 1, EVENT_HIT = 2, EVENT_END = 4 };
+
+//--------------------------------------------------------------------------------------
+// Everything the rules change
+//--------------------------------------------------------------------------------------
+struct GameState {
+    bool playing = false;
+    int score = 0;
+    int hits = 0;
+    float gameTime = 0.f;               // s left on the clock
+    float nextGameTime = 0.f;           // s on the clock after the next hit
+    Vec3 target;
+    Vec3 gloves[GLOVE_COUNT];
+    unsigned long step = 0;
+};
+
+//--------------------------------------------------------------------------------------
+// The game, advanced in fixed steps so a round plays out the same however fast it is drawn,
+// and as fast as the CPU allows without drawing it. Rendering draws the state between the
+// last two steps.
+//--------------------------------------------------------------------------------------
+class Simulation {
+public:
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    // Constructor, starting the first round. Real time beyond maxSteps steps in one advance is dropped.
+    Simulation(uint64_t seed, const GameRules &rules = GameRules(), double timestep = 1.0 / 120.0, int maxSteps = 8);
+
+    // Start over from a seed, with no round under way until one is started
+    void reset(uint64_t seed);
+
+    // Advance a single step, or as many as fit in the real time passed. Returns the GameEvents that happened.
+    unsigned step(const GameInput &input);
+    unsigned advance(double elapsed, const GameInput &input);
+
+    // Latest state, and the state the real time passed is at between the last two steps
+    const GameState &getState() const { return state; };
+    GameState interpolate() const;
+
+    GameRules &getRules() { return rules; };
+    double getTimestep() const { return timestep; };
+
+    // Whether a glove's box reaches into the target's
+    static bool isColliding(const Vec3 &obj1, const Vec3 &obj1bounds, const Vec3 &obj2, const Vec3 &obj2bounds);
+
+private:
+    //--------------------------------------------------------------------------------------
+    // Variables
+    //--------------------------------------------------------------------------------------
+
+    GameRules rules;
+    GameRandom random;
+    double timestep;
+    int maxSteps;
+    double accumulator;         // Real time not stepped yet
+
+    GameState state;
+    GameState previous;
+
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    void startRound();
+    void scorePoint();
+    void spawnTarget();
+};
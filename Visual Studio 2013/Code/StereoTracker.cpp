@@ -0,0 +1,292 @@
+//--------------------------------------------------------------------------------------
+// File: StereoTracker.cpp
+//
+// This file contains the implementations for tracking targets in 3D from a pair of cameras
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+
+#include "StereoTracker.h"
+
+//--------------------------------------------------------------------------------------
+// Read a stereo calibration
+//--------------------------------------------------------------------------------------
+bool loadStereoCalibration(const std::string &path, StereoCalibration &calibration) {
+
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        std::cout << "unable to open stereo calibration " << path << std::endl;
+        return false;
+    }
+
+    StereoCalibration loaded;
+    fs["image_width"] >> loaded.imageSize.width;
+    fs["image_height"] >> loaded.imageSize.height;
+    fs["M1"] >> loaded.M1;
+    fs["D1"] >> loaded.D1;
+    fs["M2"] >> loaded.M2;
+    fs["D2"] >> loaded.D2;
+    fs["R1"] >> loaded.R1;
+    fs["R2"] >> loaded.R2;
+    fs["P1"] >> loaded.P1;
+    fs["P2"] >> loaded.P2;
+    fs.release();
+
+    if (loaded.imageSize.area() <= 0 || loaded.M1.empty() || loaded.M2.empty() || loaded.R1.empty() || loaded.R2.empty() ||
+        loaded.P1.size() != cv::Size(4, 3) || loaded.P2.size() != cv::Size(4, 3)) {
+        std::cout << "incomplete stereo calibration in " << path << std::endl;
+        return false;
+    }
+    calibration = loaded;
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Undistort and rectify a point in each view, then triangulate them
+//--------------------------------------------------------------------------------------
+bool triangulateTarget(const StereoCalibration &calibration, cv::Point2f left, cv::Point2f right, cv::Point3f &position, float maxRowError) {
+
+    vector<cv::Point2f> leftPoints(1, left), rightPoints(1, right);
+    vector<cv::Point2f> leftRectified, rightRectified;
+    cv::undistortPoints(leftPoints, leftRectified, calibration.M1, calibration.D1, calibration.R1, calibration.P1);
+    cv::undistortPoints(rightPoints, rightRectified, calibration.M2, calibration.D2, calibration.R2, calibration.P2);
+
+    // Rectified views share their rows, so blobs far off each other's row are different objects
+    if (std::abs(leftRectified[0].y - rightRectified[0].y) > maxRowError) {
+        return false;
+    }
+
+    cv::Mat homogeneous;
+    cv::triangulatePoints(calibration.P1, calibration.P2, leftRectified, rightRectified, homogeneous);
+    homogeneous.convertTo(homogeneous, CV_64F);
+    double w = homogeneous.at<double>(3, 0);
+    if (std::abs(w) < 1e-12) {
+        return false;
+    }
+    position = cv::Point3f((float)(homogeneous.at<double>(0, 0) / w), (float)(homogeneous.at<double>(1, 0) / w),
+        (float)(homogeneous.at<double>(2, 0) / w));
+
+    // Only points in front of the cameras were seen by them
+    return position.z > 0.f;
+
+}
+
+// Frames are tracked mirrored, but were calibrated as the cameras see them
+static cv::Point2f unmirror(const cv::Point2f &point, int frameWidth) {
+
+    return cv::Point2f(frameWidth - 1 - point.x, point.y);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+StereoTracker::StereoTracker(const std::string &targetConfig, const std::string &paramsPath)
+    : maxSkew(0.02), capturing(false), dropPolicy(DROP_STALE), lockstep(false), ended(false), arrived(0), generation(0), pairsPublished(0), pairsRead(0) {
+
+    for (int view = 0; view < 2; view++) {
+        // Each view's debug window of its own, or both would draw into one
+        views[view].reset(new Tracker(targetConfig, paramsPath, "Tracker " + std::to_string(view)));
+        viewTimestamps[view] = 0.0;
+        viewRead[view] = false;
+    }
+
+}
+
+bool StereoTracker::LoadCalibration(const std::string &path) {
+
+    return loadStereoCalibration(path, calibration);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Open the two cameras, at the resolution they were calibrated at
+//--------------------------------------------------------------------------------------
+bool StereoTracker::InitCameras(int leftDevice, int rightDevice) {
+
+    cv::Size resolution = calibration.empty() ? views[0]->frameSize : calibration.imageSize;
+    return InitSources(new CameraSource(leftDevice, resolution), new CameraSource(rightDevice, resolution));
+
+}
+
+bool StereoTracker::InitSources(FrameSource *left, FrameSource *right) {
+
+    StopCaptureThreads();
+    bool leftOpened = views[0]->InitSource(left);
+    bool rightOpened = views[1]->InitSource(right);
+    return leftOpened && rightOpened;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Start reading and tracking both cameras, each on a dedicated thread
+//--------------------------------------------------------------------------------------
+bool StereoTracker::StartCaptureThreads(FrameDropPolicy policy) {
+
+    if (capturing || threads[0].joinable() || threads[1].joinable()) {
+        return false;
+    }
+
+    dropPolicy = policy;
+    lockstep = !views[0]->isSourceLive() && !views[1]->isSourceLive();
+    ended = false;
+    arrived = 0;
+    capturing = true;
+    for (int view = 0; view < 2; view++) {
+        threads[view] = std::thread(&StereoTracker::CaptureLoop, this, view);
+    }
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Stop both capture threads and wait for them to finish their current frames
+//--------------------------------------------------------------------------------------
+void StereoTracker::StopCaptureThreads() {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        capturing = false;
+    }
+    changed.notify_all();
+    for (int view = 0; view < 2; view++) {
+        if (threads[view].joinable()) {
+            threads[view].join();
+        }
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Capture thread of one view. Each frame waits for the other view's, and whichever thread
+// arrives last pairs them up before both go on to their next frames.
+//--------------------------------------------------------------------------------------
+void StereoTracker::CaptureLoop(int view) {
+
+    vector<TrackResult> results;
+    double timestamp = 0.0;
+
+    while (capturing) {
+        bool read = views[view]->TrackNextFrame(results, timestamp, dropPolicy);
+
+        // Copied, as results holds on to this view's last results for the targets its motion
+        // gate skips next frame
+        std::unique_lock<std::mutex> lock(mutex);
+        viewResults[view] = results;
+        viewSizes[view] = views[view]->getTrackedFrameSize();
+        viewTimestamps[view] = timestamp;
+        viewRead[view] = read;
+        if (++arrived == 2) {
+            arrived = 0;
+            PairViews(lock);
+            generation++;
+            changed.notify_all();
+        } else {
+            unsigned long current = generation;
+            changed.wait(lock, [&] { return generation != current || !capturing; });
+        }
+        bool paired = viewRead[0] && viewRead[1];
+        lock.unlock();
+
+        // A camera that missed a frame is given a moment before both try again
+        if (!paired) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Triangulate the targets of a pair of frames and publish them, waiting for the reader
+// to take them when replaying recordings. Called with the lock held.
+//--------------------------------------------------------------------------------------
+void StereoTracker::PairViews(std::unique_lock<std::mutex> &lock) {
+
+    if (!viewRead[0] || !viewRead[1]) {
+        // A replay is over as soon as either recording is
+        if (lockstep) {
+            ended = true;
+            capturing = false;
+        }
+        return;
+    }
+
+    StereoSnapshot &snapshot = snapshots.writeBuffer();
+    snapshot.views[0].assign(viewResults[0].begin(), viewResults[0].end());
+    snapshot.views[1].assign(viewResults[1].begin(), viewResults[1].end());
+    snapshot.skew = std::abs(viewTimestamps[0] - viewTimestamps[1]);
+    snapshot.pairNumber = ++pairsPublished;
+
+    // The calibration only holds for frames of the size it was made at
+    const bool calibrated = !calibration.empty() && viewSizes[0] == calibration.imageSize && viewSizes[1] == calibration.imageSize;
+    const size_t targets = std::min(snapshot.views[0].size(), snapshot.views[1].size());
+    snapshot.results.resize(targets);
+    for (size_t i = 0; i < targets; i++) {
+        const TrackResult &left = snapshot.views[0][i];
+        const TrackResult &right = snapshot.views[1][i];
+        StereoResult &result = snapshot.results[i];
+        result.triangulated = calibrated && snapshot.skew <= maxSkew && left.radius > 0.f && right.radius > 0.f &&
+            triangulateTarget(calibration, unmirror(left.centroid, viewSizes[0].width), unmirror(right.centroid, viewSizes[1].width), result.position);
+    }
+    snapshots.publish();
+
+    if (lockstep) {
+        changed.notify_all();
+        changed.wait(lock, [this] { return pairsRead == pairsPublished || !capturing; });
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Poll the capture threads for a newer pair, handing each view its results
+//--------------------------------------------------------------------------------------
+bool StereoTracker::UpdateCameras() {
+
+    if (!snapshots.update()) {
+        return false;
+    }
+
+    const StereoSnapshot &snapshot = snapshots.readBuffer();
+    views[0]->UpdateResults(snapshot.views[0]);
+    views[1]->UpdateResults(snapshot.views[1]);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pairsRead = snapshot.pairNumber;
+    }
+    changed.notify_all();
+    return true;
+
+}
+
+bool StereoTracker::WaitForPair() {
+
+    while (true) {
+        if (UpdateCameras()) {
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return pairsPublished != pairsRead || ended || !capturing; });
+        if (pairsPublished == pairsRead) {
+            return false;
+        }
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Position of a target in the latest pair
+//--------------------------------------------------------------------------------------
+bool StereoTracker::isTriangulated(size_t target) {
+
+    const vector<StereoResult> &results = snapshots.readBuffer().results;
+    return target < results.size() && results[target].triangulated;
+
+}
+
+cv::Point3f StereoTracker::getPosition(size_t target) {
+
+    const vector<StereoResult> &results = snapshots.readBuffer().results;
+    return target < results.size() ? results[target].position : cv::Point3f();
+
+}
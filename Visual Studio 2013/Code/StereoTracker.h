@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------------------------
+// File: StereoTracker.h
+//
+// This file contains the definitions for tracking targets in 3D from a pair of cameras
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include "tracker.h"
+
+//--------------------------------------------------------------------------------------
+// Calibration of a pair of cameras, as written by cv::stereoCalibrate and cv::stereoRectify
+//--------------------------------------------------------------------------------------
+struct StereoCalibration {
+    cv::Size imageSize;         // Frame size the cameras were calibrated at
+    cv::Mat M1, D1;             // Left camera matrix and distortion
+    cv::Mat M2, D2;             // Right camera matrix and distortion
+    cv::Mat R1, R2;             // Rectifying rotations
+    cv::Mat P1, P2;             // Projections of the rectified cameras
+
+    bool empty() const { return P1.empty() || P2.empty(); };
+};
+
+// Read a calibration from YAML, with keys named as in OpenCV's stereo_calib sample plus the
+// image_width and image_height it was taken at
+extern bool loadStereoCalibration(const std::string &path, StereoCalibration &calibration);
+
+// Position of a point seen at a pixel of each unmirrored frame, in the rectified left camera's
+// frame and the units of the calibration. Fails for points whose rectified rows disagree by
+// more than maxRowError pixels, which can't be the same point.
+extern bool triangulateTarget(const StereoCalibration &calibration, cv::Point2f left, cv::Point2f right, cv::Point3f &position,
+    float maxRowError = 4.f);
+
+//--------------------------------------------------------------------------------------
+// Position of a target seen by both cameras
+//--------------------------------------------------------------------------------------
+struct StereoResult {
+    cv::Point3f position;
+    bool triangulated = false;
+};
+
+//--------------------------------------------------------------------------------------
+// A pair of frames tracked together, published by the capture threads
+//--------------------------------------------------------------------------------------
+struct StereoSnapshot {
+    vector<TrackResult> views[2];
+    vector<StereoResult> results;
+    double skew = 0.0;              // s between the two frames' capture times
+    unsigned long pairNumber = 0;
+};
+
+//--------------------------------------------------------------------------------------
+// Tracks the same targets from two cameras, each read and tracked on a thread of its own,
+// and triangulates their positions. The threads grab their next frames together, so the
+// frames of a pair are taken as close in time as the cameras allow. Recorded clips are
+// replayed in lockstep with whoever reads the pairs, so none are skipped.
+//--------------------------------------------------------------------------------------
+class StereoTracker {
+public:
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    // Constructor and Destructor, each view loading the targets and tracking parameters, and
+    // showing its debug window as "Tracker 0" or "Tracker 1"
+    StereoTracker(const std::string &targetConfig = "Histograms/targets.yml", const std::string &paramsPath = "Histograms/tracker_params.yml");
+    ~StereoTracker() { StopCaptureThreads(); };
+
+    bool LoadCalibration(const std::string &path);
+    void setCalibration(const StereoCalibration &calibration) { this->calibration = calibration; };
+    bool isCalibrated() { return !calibration.empty(); };
+
+    // Camera data, from two camera devices or two other sources, which the tracker takes ownership of
+    bool InitCameras(int leftDevice = 0, int rightDevice = 1);
+    bool InitSources(FrameSource *left, FrameSource *right);
+
+    // Live cameras drop frames as the policy says, each view counting its own in getDroppedFrames
+    bool StartCaptureThreads(FrameDropPolicy policy = DROP_STALE);
+    void StopCaptureThreads();
+
+    // Pick up the newest pair of results, if there is one. Returns whether there was.
+    bool UpdateCameras();
+    // Wait for the next pair of results. Returns false once either source runs out of frames.
+    bool WaitForPair();
+
+    // Frames further apart than this aren't triangulated
+    void setMaxSkew(double seconds) { maxSkew = seconds; };
+
+    // Each camera's tracker, whose results are those of the latest pair
+    Tracker &getView(int view) { return *views[view]; };
+
+    // Ball tracking data of the latest pair
+    size_t getTargetCount() { return views[0]->getTargetCount(); };
+    const StereoSnapshot &getPair() { return snapshots.readBuffer(); };
+    bool isTriangulated(size_t target);
+    cv::Point3f getPosition(size_t target);
+
+private:
+    //--------------------------------------------------------------------------------------
+    // Variables
+    //--------------------------------------------------------------------------------------
+
+    std::unique_ptr<Tracker> views[2];
+    StereoCalibration calibration;
+    double maxSkew;
+
+    // Capture thread state
+    std::thread threads[2];
+    std::atomic<bool> capturing;
+    FrameDropPolicy dropPolicy;
+    bool lockstep;              // Both sources are recordings
+    bool ended;
+    TripleBuffer<StereoSnapshot> snapshots;
+
+    // Frame barrier between the capture threads, and the pairs handed to the reader
+    std::mutex mutex;
+    std::condition_variable changed;
+    int arrived;
+    unsigned long generation;
+    vector<TrackResult> viewResults[2];
+    cv::Size viewSizes[2];
+    double viewTimestamps[2];
+    bool viewRead[2];
+    unsigned long pairsPublished;
+    unsigned long pairsRead;
+
+    //--------------------------------------------------------------------------------------
+    // Functions
+    //--------------------------------------------------------------------------------------
+
+    void CaptureLoop(int view);
+    void PairViews(std::unique_lock<std::mutex> &lock);
+
+    StereoTracker(const StereoTracker&);
+    StereoTracker &operator=(const StereoTracker&);
+};
@@ -0,0 +1,137 @@
+//--------------------------------------------------------------------------------------
+// File: TargetSet.cpp
+//
+// This file contains the implementations for the set of coloured targets the tracker follows
+//--------------------------------------------------------------------------------------
+
+#include "HistogramCache.h"
+#include "TargetSet.h"
+
+//--------------------------------------------------------------------------------------
+// Remove every target
+//--------------------------------------------------------------------------------------
+void TargetSet::clear() {
+
+    names.clear();
+    colours.clear();
+    hists.clear();
+    hsvCodes.clear();
+    luts.clear();
+    yuyvLuts.clear();
+    results.clear();
+    filters.clear();
+
+}
+
+//--------------------------------------------------------------------------------------
+// Add a target, with no result yet
+//--------------------------------------------------------------------------------------
+void TargetSet::add(const std::string &name, const cv::Scalar &colour, const cv::MatND &hist, int hsvCode, int lutBits) {
+
+    BackProjectLUT lut;
+    if (lutBits) {
+        lut.build(hist, lutBits, hsvCode);
+    }
+    add(name, colour, hist, hsvCode, lut);
+
+}
+
+void TargetSet::add(const std::string &name, const cv::Scalar &colour, const cv::MatND &hist, int hsvCode, const BackProjectLUT &lut,
+    const BackProjectLUT &yuyvLut) {
+
+    names.push_back(name);
+    colours.push_back(colour);
+    hists.push_back(hist);
+    hsvCodes.push_back(hsvCode);
+    luts.push_back(lut);
+    yuyvLuts.push_back(yuyvLut);
+    results.push_back(TrackResult());
+    filters.push_back(MotionFilter());
+
+}
+
+//--------------------------------------------------------------------------------------
+// Bake the tables for YUYV frames that didn't come from the cache
+//--------------------------------------------------------------------------------------
+void TargetSet::buildYUYVLuts(int lutBits) {
+
+    for (size_t i = 0; i < size(); i++) {
+        if (yuyvLuts[i].empty() || yuyvLuts[i].getBits() != lutBits) {
+            yuyvLuts[i].buildYUYV(hists[i], lutBits, hsvCodes[i]);
+        }
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Read a trained histogram. Histograms trained on the full 0-255 hue range say so, older
+// ones used 0-180.
+//--------------------------------------------------------------------------------------
+bool loadHistogram(const std::string &path, cv::MatND &hist, int &hsvCode) {
+
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        std::cout << "unable to open file storage " << path << std::endl;
+        return false;
+    }
+    fs["histogram"] >> hist;
+    int hueFull = 0;
+    if (!fs["hue_full"].empty()) {
+        fs["hue_full"] >> hueFull;
+    }
+    hsvCode = hueFull ? CV_RGB2HSV_FULL : CV_RGB2HSV;
+    fs.release();
+
+    if (!hist.data || hist.dims != 2 || hist.type() != CV_32F) {
+        std::cout << "no hue-saturation histogram in " << path << std::endl;
+        return false;
+    }
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Load the targets listed in a config file, such as
+//
+//   targets:
+//      - { name: Green, histogram: colour_hist_GREEN.yml, colour: [ 0, 255, 0 ] }
+//
+// Targets keep the order they are listed in. Fails without changing the set if the config
+// or any of its histograms can't be read.
+//--------------------------------------------------------------------------------------
+bool loadTargetSet(const std::string &path, TargetSet &targets, int lutBits) {
+
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        std::cout << "unable to open target config " << path << std::endl;
+        return false;
+    }
+
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    cv::FileNode list = fs["targets"];
+    TargetSet loaded;
+    for (cv::FileNodeIterator it = list.begin(); it != list.end(); ++it) {
+        cv::FileNode node = *it;
+
+        cv::MatND hist;
+        int hsvCode;
+        BackProjectLUT lut, yuyvLut;
+        if (!loadCachedHistogram(directory + (std::string)node["histogram"], lutBits, hist, hsvCode, lut, yuyvLut)) {
+            return false;
+        }
+
+        vector<int> colour;
+        node["colour"] >> colour;
+        colour.resize(3, 255);
+        loaded.add((std::string)node["name"], cv::Scalar(colour[0], colour[1], colour[2]), hist, hsvCode, lut, yuyvLut);
+    }
+    fs.release();
+
+    if (loaded.size() == 0) {
+        std::cout << "no targets listed in " << path << std::endl;
+        return false;
+    }
+    targets = loaded;
+    return true;
+
+}
@@ -0,0 +1,44 @@
+//--------------------------------------------------------------------------------------
+// File: TargetSet.h
+//
+// This file contains the definitions for the set of coloured targets the tracker follows
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "BackProjectLUT.h"
+#include "MotionFilter.h"
+#include "OpenCVToolkit.h"
+
+//--------------------------------------------------------------------------------------
+// Tracked targets, kept as parallel arrays indexed by target. The pipeline takes all the
+// histograms and lookup tables at once, and fills in all the results in one frame pass.
+//--------------------------------------------------------------------------------------
+struct TargetSet {
+    vector<std::string> names;
+    vector<cv::Scalar> colours;         // Marker colour in the camera window
+    vector<cv::MatND> hists;
+    vector<int> hsvCodes;               // HSV conversion each histogram was trained with
+    vector<BackProjectLUT> luts;
+    vector<BackProjectLUT> yuyvLuts;    // For cameras delivering YUYV, empty until cached or baked
+    vector<TrackResult> results;
+    vector<MotionFilter> filters;
+
+    size_t size() const { return names.size(); };
+    void clear();
+
+    // Add a target tracked with a histogram, baking its lookup table unless lutBits is 0, or
+    // with tables baked already
+    void add(const std::string &name, const cv::Scalar &colour, const cv::MatND &hist, int hsvCode, int lutBits);
+    void add(const std::string &name, const cv::Scalar &colour, const cv::MatND &hist, int hsvCode, const BackProjectLUT &lut,
+        const BackProjectLUT &yuyvLut = BackProjectLUT());
+    // Bake every target's YUYV lookup table that isn't baked at that bit depth already
+    void buildYUYVLuts(int lutBits);
+};
+
+// Read a trained histogram from its YAML, along with the HSV conversion it was trained with
+extern bool loadHistogram(const std::string &path, cv::MatND &hist, int &hsvCode);
+
+// Load the targets listed in a config file, each with a name, a histogram file relative to
+// the config file, and a BGR marker colour. Histograms come from their binary caches.
+extern bool loadTargetSet(const std::string &path, TargetSet &targets, int lutBits);
@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// File: TrackerParams.cpp
+//
+// This file contains the implementations for the tracking parameters loaded at runtime
+//--------------------------------------------------------------------------------------
+
+#include "OpenCVToolkit.h"
+#include "TrackerParams.h"
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+TrackerParams::TrackerParams() : hbins(::hbins), sbins(::sbins), thre(::thre), tolerance(::tolerance), denoiseKernel(3), maskKernel(3) {
+
+}
+
+bool TrackerParams::isValid() const {
+
+    return hbins > 0 && hbins <= 256 && sbins > 0 && sbins <= 256 &&
+        thre >= 0 && thre < 255 && tolerance >= 0 && tolerance <= 255 &&
+        denoiseKernel >= 1 && denoiseKernel % 2 == 1 && maskKernel >= 1 && maskKernel % 2 == 1;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Read parameters, failing without changing them if the file can't be read or holds values
+// the pipeline doesn't support
+//--------------------------------------------------------------------------------------
+static void readInt(const cv::FileStorage &fs, const char *name, int &value) {
+
+    if (!fs[name].empty()) {
+        fs[name] >> value;
+    }
+
+}
+
+bool loadTrackerParams(const std::string &path, TrackerParams &params) {
+
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        std::cout << "unable to open tracker params " << path << std::endl;
+        return false;
+    }
+
+    TrackerParams loaded = params;
+    readInt(fs, "hbins", loaded.hbins);
+    readInt(fs, "sbins", loaded.sbins);
+    readInt(fs, "thre", loaded.thre);
+    readInt(fs, "tolerance", loaded.tolerance);
+    readInt(fs, "denoise_kernel", loaded.denoiseKernel);
+    readInt(fs, "mask_kernel", loaded.maskKernel);
+    fs.release();
+
+    if (!loaded.isValid()) {
+        std::cout << "tracker params out of range in " << path << std::endl;
+        return false;
+    }
+    params = loaded;
+    return true;
+
+}
+
+bool saveTrackerParams(const std::string &path, const TrackerParams &params) {
+
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        std::cout << "unable to open file storage " << path << std::endl;
+        return false;
+    }
+
+    fs << "hbins" << params.hbins;
+    fs << "sbins" << params.sbins;
+    fs << "thre" << params.thre;
+    fs << "tolerance" << params.tolerance;
+    fs << "denoise_kernel" << params.denoiseKernel;
+    fs << "mask_kernel" << params.maskKernel;
+    fs.release();
+    return true;
+
+}
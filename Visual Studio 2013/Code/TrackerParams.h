@@ -0,0 +1,31 @@
+//--------------------------------------------------------------------------------------
+// File: TrackerParams.h
+//
+// This file contains the definitions for the tracking parameters loaded at runtime
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+
+//--------------------------------------------------------------------------------------
+// Tracking parameters that can be tuned per venue. Defaults are the built in settings of
+// OpenCVToolkit.cpp.
+//--------------------------------------------------------------------------------------
+struct TrackerParams {
+    int hbins;              // Hue and saturation bins histograms are trained with
+    int sbins;
+    int thre;               // Back projection value a pixel must exceed to be marked
+    int tolerance;          // Largest step between neighbouring marked pixels of one region
+    int denoiseKernel;      // Size of the square open of the back projection, 1 for none
+    int maskKernel;         // Size of the square open of the marked pixels, 1 for none
+
+    TrackerParams();
+
+    // Whether each value is in the range the pipeline supports
+    bool isValid() const;
+};
+
+// Read and write parameters as YAML. Values missing from the file keep their defaults.
+extern bool loadTrackerParams(const std::string &path, TrackerParams &params);
+extern bool saveTrackerParams(const std::string &path, const TrackerParams &params);
@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// File: TripleBuffer.h
+//
+// This file contains a lock-free triple buffer for handing the latest value from one
+// producer thread to one consumer thread, without either side ever waiting
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+
+//--------------------------------------------------------------------------------------
+// The writer fills its back buffer and publishes it, the reader picks up the most recently
+// published buffer. Values published faster than they are read are overwritten, so the
+// reader always sees the newest one.
+//--------------------------------------------------------------------------------------
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : writeIndex(0), shared(1), readIndex(2) {}
+
+    // Writer side: the buffer to fill, then make it visible to the reader
+    T &writeBuffer() { return buffers[writeIndex]; }
+    void publish() {
+        int previous = shared.exchange(writeIndex | dirtyFlag, std::memory_order_acq_rel);
+        writeIndex = previous & indexMask;
+    }
+
+    // Reader side: swap in the newest published buffer, if there is one, then read it
+    bool update() {
+        if (!(shared.load(std::memory_order_acquire) & dirtyFlag)) {
+            return false;
+        }
+        int previous = shared.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & indexMask;
+        return true;
+    }
+    T &readBuffer() { return buffers[readIndex]; }
+
+private:
+    static const int indexMask = 3;
+    static const int dirtyFlag = 4;
+
+    T buffers[3];
+    int writeIndex;
+    std::atomic<int> shared;
+    int readIndex;
+
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer &operator=(const TripleBuffer&);
+};
@@ -31,7 +31,9 @@
 #endif
 
 #include "tracker.h"
+#include "StereoTracker.h"
 #include "Graphics.h"
+#include "Simulation.h"
 
 using namespace DirectX;
 
@@ -80,24 +82,15 @@ XMMATRIX        g_Projection;
 
 Graphics*       graphics;
 Tracker*        cameraInput;
+// Second camera for real depth, when a stereo calibration is present. cameraInput is then its left view.
+StereoTracker*  stereoInput = nullptr;
 
-// Target positioning
-bool            playing = true;
-int             score = 0;
-float           current_game_time = 10.f;
-float           next_game_time = 9.f;
-bool            new_Target = true;
-XMVECTOR        target_Pos;
-float           x_min = -5.f;
-float           x_max = 5.f;
-float           y_min = -2.f;
-float           y_max = 2.f;
-float           z_min = 10.f;
-float           z_max = 25.f;
-XMVECTOR        red_pos;
-XMVECTOR        green_pos;
-XMVECTOR        ball_bounds = { 1.f, 1.f, 1.f };
-XMVECTOR        target_bounds = { 1.5f, 1.5f, 1.f };
+// Tracker targets the gloves are drawn from, found by their names in Histograms/targets.yml
+size_t          greenBall = 0;
+size_t          redBall = 1;
+
+// Game rules, stepped apart from rendering
+Simulation*     simulation = nullptr;
 
 //--------------------------------------------------------------------------------------
 // Forward declarations
@@ -109,10 +102,6 @@ LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 
 void                Render(float deltaTime);
 
-bool                isColliding(XMVECTOR *obj1, XMVECTOR *obj1bounds, XMVECTOR *obj2, XMVECTOR *obj2bounds);
-float               randomNumber(float lower_bound, float upper_bound);
-void                scorePoint();
-
 bool                ReadKeyboard();
 
 //--------------------------------------------------------------------------------------
@@ -140,8 +129,8 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     static const float targetFramerate = 30.0f;
     static const float maxTimeStep = 1.0f / targetFramerate;
 
-    // Seed rand
-    srand(static_cast <unsigned> (time(0)));
+    // Seed each game differently, so every game gets targets of its own
+    simulation = new Simulation(static_cast<uint64_t>(time(0)));
 
     while (WM_QUIT != msg.message) {
         if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
@@ -163,8 +152,12 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
                 msg.message = WM_QUIT;
             }
 
-
-            cameraInput->UpdateCamera();
+            // Pick up the latest tracking results, without blocking
+            if (stereoInput) {
+                stereoInput->UpdateCameras();
+            } else {
+                cameraInput->UpdateCamera();
+            }
 
             Render(deltaTime);
         }
@@ -226,11 +219,39 @@ HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow) {
 
     ShowWindow(g_hWnd, nCmdShow);
 
-    cameraInput = new Tracker();
-    if (!cameraInput->InitCamera()) {
+    // Track in 3D from two cameras when they have been calibrated together, or else from one.
+    // The calibration is read first, so single camera setups only load the targets once.
+    StereoCalibration calibration;
+    if (loadStereoCalibration("Histograms/stereo_calibration.yml", calibration)) {
+        stereoInput = new StereoTracker();
+        stereoInput->setCalibration(calibration);
+        if (stereoInput->InitCameras(0, 1)) {
+            cameraInput = &stereoInput->getView(0);
+        } else {
+            delete stereoInput;
+            stereoInput = nullptr;
+        }
+    }
+    if (!stereoInput) {
+        cameraInput = new Tracker();
+        if (!cameraInput->InitCamera()) {
+            return E_FAIL;
+        }
+    }
+
+    // The gloves are whichever targets are named Red and Green, wherever the config lists them
+    if (!cameraInput->findTarget("Red", redBall) || !cameraInput->findTarget("Green", greenBall)) {
+        std::cout << "Histograms/targets.yml needs targets named Red and Green" << std::endl;
         return E_FAIL;
     }
 
+    // Read and track camera frames on their own threads, so rendering never waits on the webcams
+    if (stereoInput) {
+        stereoInput->StartCaptureThreads();
+    } else {
+        cameraInput->StartCaptureThread(DROP_STALE);
+    }
+
     return S_OK;
 
 }
@@ -443,7 +464,13 @@ void CleanupDevice() {
     if (g_pd3dDevice) g_pd3dDevice->Release();
 
     graphics->~Graphics();
-    cameraInput->~Tracker();
+    delete simulation;
+    simulation = nullptr;
+    if (stereoInput) {
+        stereoInput->~StereoTracker();
+    } else {
+        cameraInput->~Tracker();
+    }
 
 #ifdef DXTK_AUDIO
     g_audEngine.reset();
@@ -627,120 +654,50 @@ void Render(float deltaTime) {
     // Update game logic
     //------------------------------------
 
-    if (playing) {
-        red_pos = { (cameraInput->getRedPosition().x - (frameSize.width / 2.f)) / 50.f,
-            -(cameraInput->getRedPosition().y - (frameSize.height / 2.f)) / 50.f,
-            max(cameraInput->getRedSize() / 200.f, 4.f) };
-
-        green_pos = { (cameraInput->getGreenPosition().x - (frameSize.width / 2.f)) / 50.f,
-            -(cameraInput->getGreenPosition().y - (frameSize.height / 2.f)) / 50.f,
-            max(cameraInput->getGreenSize() / 200.f, 4.f) };
-
-        // If you hit the target, reset its position and give yourself some points
-        if (isColliding(&red_pos, &ball_bounds, &target_Pos, &target_bounds) || isColliding(&green_pos, &ball_bounds, &target_Pos, &target_bounds)) {
-            new_Target = true;
-            scorePoint();
-
-            // Play the hit effect
-            g_effectHit->Stop();
-            g_effectHit->Play();
-        }
-
-        // If the target has been hit, set a new place for it
-        if (new_Target) {
-            target_Pos = { randomNumber(x_min, x_max), randomNumber(y_min, y_max), randomNumber(z_min, z_max) };
-            new_Target = false;
-        }
-
-        current_game_time -= deltaTime;
-
-        if (current_game_time <= 0.f) {
-            current_game_time = 0.f;
-            playing = false;
-        }
-    } else {
-        // Press space to start a new game
-        if (m_keyboardState[DIK_SPACE] & 0x80) {
-            playing = true;
-            new_Target = true;
-            current_game_time = 10.f;
-            next_game_time = 9.f;
-            score = 0;
-
-            // Play the bell sound on game start
-            g_effectBell->Stop();
-            g_effectBell->Play();
+    // Where the gloves are now, rather than where they were when the camera saw them
+    GameInput input;
+    double now = Tracker::now();
+    const size_t balls[GLOVE_COUNT] = { redBall, greenBall };
+    for (int i = 0; i < GLOVE_COUNT; i++) {
+        cv::Point2f position = cameraInput->getPosition(balls[i], now);
+        input.gloves[i] = gloveFromCamera(position.x, position.y, cameraInput->getSize(balls[i], now), frameSize.width, frameSize.height);
+
+        // Measured positions where both cameras see a glove, judged with the tighter stereo bounds
+        if (stereoInput && stereoInput->isTriangulated(balls[i])) {
+            cv::Point3f measured = stereoInput->getPosition(balls[i]);
+            input.gloves[i] = gloveFromStereo(measured.x, measured.y, measured.z);
+            input.triangulated[i] = true;
         }
     }
 
-    // Render everything defined in the graphics class
-    graphics->Render(&g_World, &g_View, &g_Projection, g_pd3dDevice, g_pImmediateContext, cameraInput->getGreenTrackerString(), cameraInput->getRedTrackerString(), &green_pos, &red_pos, &target_Pos, score, current_game_time, playing, ScreenWidth, ScreenHeight);
-
-    // Present our back buffer to our front buffer
-    g_pSwapChain->Present(0, 0);
-
-}
-
-//--------------------------------------------------------------------------------------
-// Returns whether or not two objects are colliding
-//--------------------------------------------------------------------------------------
-bool isColliding(XMVECTOR *obj1, XMVECTOR *obj1bounds, XMVECTOR *obj2, XMVECTOR *obj2bounds) {
-
-    XMVECTOR vMin1, vMax1, vMin2, vMax2;
-
-    // Calculate the minimum and maximum points for both objects bounding boxes
-
-    vMin1 = { XMVectorGetX(*obj1) - (XMVectorGetX(*obj1bounds) / 2.f),
-        XMVectorGetY(*obj1) - (XMVectorGetY(*obj1bounds) / 2.f),
-        XMVectorGetZ(*obj1) - (XMVectorGetZ(*obj1bounds) / 2.f) };
-
-    vMax1 = { XMVectorGetX(*obj1) + (XMVectorGetX(*obj1bounds) / 2.f),
-        XMVectorGetY(*obj1) + (XMVectorGetY(*obj1bounds) / 2.f),
-        XMVectorGetZ(*obj1) + (XMVectorGetZ(*obj1bounds) / 2.f) };
-
-    vMin2 = { XMVectorGetX(*obj2) - (XMVectorGetX(*obj2bounds) / 2.f),
-        XMVectorGetY(*obj2) - (XMVectorGetY(*obj2bounds) / 2.f),
-        XMVectorGetZ(*obj2) - (XMVectorGetZ(*obj2bounds) / 2.f) };
-
-    vMax2 = { XMVectorGetX(*obj2) + (XMVectorGetX(*obj2bounds) / 2.f),
-        XMVectorGetY(*obj2) + (XMVectorGetY(*obj2bounds) / 2.f),
-        XMVectorGetZ(*obj2) + (XMVectorGetZ(*obj2bounds) / 2.f) };
+    // Press space to start a new game
+    input.start = (m_keyboardState[DIK_SPACE] & 0x80) != 0;
 
-    // If either of them overlap, we have a collision
+    unsigned events = simulation->advance(deltaTime, input);
 
-    if (XMVectorGetX(vMin1) > XMVectorGetX(vMin2) && XMVectorGetX(vMin1) < XMVectorGetX(vMax2)
-        && XMVectorGetY(vMin1) > XMVectorGetY(vMin2) && XMVectorGetY(vMin1) < XMVectorGetY(vMax2)
-        && XMVectorGetZ(vMin1) > XMVectorGetZ(vMin2) && XMVectorGetZ(vMin1) < XMVectorGetZ(vMax2)) {
-        return true;
+    // Play the hit effect
+    if (events & EVENT_HIT) {
+        g_effectHit->Stop();
+        g_effectHit->Play();
     }
 
-    if (XMVectorGetX(vMax1) > XMVectorGetX(vMin2) && XMVectorGetX(vMax1) < XMVectorGetX(vMax2)
-        && XMVectorGetY(vMax1) > XMVectorGetY(vMin2) && XMVectorGetY(vMax1) < XMVectorGetY(vMax2)
-        && XMVectorGetZ(vMax1) > XMVectorGetZ(vMin2) && XMVectorGetZ(vMax1) < XMVectorGetZ(vMax2)) {
-        return true;
+    // Play the bell sound on game start
+    if (events & EVENT_START) {
+        g_effectBell->Stop();
+        g_effectBell->Play();
     }
 
-    return false;
+    // Draw the game between its last two steps, so the gloves move smoothly at any framerate
+    GameState state = simulation->interpolate();
+    XMVECTOR red_pos = { state.gloves[GLOVE_RED].x, state.gloves[GLOVE_RED].y, state.gloves[GLOVE_RED].z };
+    XMVECTOR green_pos = { state.gloves[GLOVE_GREEN].x, state.gloves[GLOVE_GREEN].y, state.gloves[GLOVE_GREEN].z };
+    XMVECTOR target_Pos = { state.target.x, state.target.y, state.target.z };
 
-}
-
-//--------------------------------------------------------------------------------------
-// Return a random number between two bounds
-//--------------------------------------------------------------------------------------
-float randomNumber(float lower_bound, float upper_bound) {
-
-    return lower_bound + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / (upper_bound - lower_bound)));
-
-}
-
-//--------------------------------------------------------------------------------------
-// Update player score and set the set the updated score timer
-//--------------------------------------------------------------------------------------
-void scorePoint() {
+    // Render everything defined in the graphics class
+    graphics->Render(&g_World, &g_View, &g_Projection, g_pd3dDevice, g_pImmediateContext, cameraInput->getTrackerString(greenBall), cameraInput->getTrackerString(redBall), &green_pos, &red_pos, &target_Pos, state.score, state.gameTime, state.playing, ScreenWidth, ScreenHeight);
 
-    score += (int)(current_game_time * 10.f);
-    current_game_time = next_game_time;
-    next_game_time -= next_game_time / 10.f;
+    // Present our back buffer to our front buffer
+    g_pSwapChain->Present(0, 0);
 
 }
 
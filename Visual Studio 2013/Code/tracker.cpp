@@ -4,29 +4,48 @@
 // This file contains the implementations for obtaining object tracking data
 //--------------------------------------------------------------------------------------
 
+#include <chrono>
+
 #include "tracker.h"
 
+// A grab that returns faster than this handed back a frame the camera had already queued
+static const double staleGrabTime = 4.0; //ms
+// Most frames a camera driver will have queued up
+static const int maxStaleFrames = 4;
+// Bits per channel of the back projection lookup tables
+static const int lutBits = 6;
+
 //--------------------------------------------------------------------------------------
 // Constructor
 //--------------------------------------------------------------------------------------
-Tracker::Tracker() {
-
-    tracker_green = cv::Point(0, 0);
-    tracker_red = cv::Point(0, 0);
-    size_green = cv::Size(0, 0);
-    size_red = cv::Size(0, 0);
-
-    // Initialise the green ball tracker
-    cv::FileStorage fs_g("Histograms/colour_hist_GREEN.yml", cv::FileStorage::READ);
-    if (!fs_g.isOpened()) { std::cout << "unable to open file storage!" << std::endl; }
-    fs_g["histogram"] >> hist_green;
-    fs_g.release();
+Tracker::Tracker(const std::string &targetConfig, const std::string &paramsPath, const std::string &windowName) : rawCapture(false), capturing(false), droppedFrames(0),
+    windowedTracking(true), pyramidLevel(0), motionGating(true), viewer(windowName), profiling(false), lookupBackProjection(true), histogramAdaptation(false), parallelStripes(1), incrementalLabelling(false), maxDirtyRatio(0.25f) {
 
-    // Inititalise the red ball tracker
-    cv::FileStorage fs_r("Histograms/colour_hist_RED.yml", cv::FileStorage::READ);
-    if (!fs_r.isOpened()) { std::cout << "unable to open file storage!" << std::endl; }
-    fs_r["histogram"] >> hist_red;
-    fs_r.release();
+    // Parameters tuned for the venue, or the built in ones
+    if (!loadTrackerParams(paramsPath, params)) {
+        params = TrackerParams();
+    }
+    workspace.params = params;
+
+    // Initialise the ball trackers, falling back to the green and red balls without a config
+    if (!loadTargetSet(targetConfig, targets, lutBits)) {
+        const char *names[] = { "Green", "Red" };
+        const char *paths[] = { "Histograms/colour_hist_GREEN.yml", "Histograms/colour_hist_RED.yml" };
+        const cv::Scalar colours[] = { cv::Scalar(0, 255, 0), cv::Scalar(0, 0, 255) };
+        for (int i = 0; i < 2; i++) {
+            cv::MatND hist;
+            int hsvCode;
+            BackProjectLUT lut, yuyvLut;
+            if (!loadCachedHistogram(paths[i], lutBits, hist, hsvCode, lut, yuyvLut)) {
+                // Track nothing rather than whatever an empty histogram matches
+                hist = cv::Mat::zeros(cv::Size(params.sbins, params.hbins), CV_32F);
+                hsvCode = CV_RGB2HSV;
+                lut.build(hist, lutBits, hsvCode);
+            }
+            targets.add(names[i], colours[i], hist, hsvCode, lut, yuyvLut);
+        }
+    }
+    workspace.reserve(frameSize, targets.size());
 
 }
 
@@ -35,100 +54,358 @@ Tracker::Tracker() {
 //--------------------------------------------------------------------------------------
 Tracker::~Tracker() {
 
-    hist_green.release();
-    hist_red.release();
+    StopCaptureThread();
+    viewer.stop();
+    adapter.stop();
+    if (source) {
+        source->release();
+    }
 
 }
 
-bool Tracker::InitCamera() {
-
-    if (!webcam.isOpened()) {
+bool Tracker::InitCamera(bool v4l2) {
+
+    StopCaptureThread();
+    source.reset();
+#ifdef __linux__
+    // Stream YUYV straight from the driver when asked to
+    if (v4l2) {
+        source.reset(new V4L2Source("/dev/video0", frameSize));
+        if (!source->isOpened()) {
+            std::cout << "Cannot open /dev/video0 through V4L2, opening it through OpenCV" << std::endl;
+            source.reset();
+        }
+    }
+#endif
+    if (!source) {
+        source.reset(new CameraSource(0, frameSize));
+    }
+    if (!source->isOpened()) {
         std::cout << "Cannot open the video cam" << std::endl;
         return false;
     }
+    PrepareSource();
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Track frames from another source, such as a recorded clip. The tracker takes ownership.
+//--------------------------------------------------------------------------------------
+bool Tracker::InitSource(FrameSource *frameSource) {
+
+    StopCaptureThread();
+    source.reset(frameSource);
+    if (!source || !source->isOpened()) {
+        std::cout << "Cannot open the frame source" << std::endl;
+        return false;
+    }
+    PrepareSource();
     return true;
 
 }
 
+//--------------------------------------------------------------------------------------
+// Bake any YUYV tables the cache didn't hold before the first frame, rather than on the
+// capture thread when it arrives
+//--------------------------------------------------------------------------------------
+void Tracker::PrepareSource() {
+
+    if (source->lendsYUYV()) {
+        targets.buildYUYVLuts(lutBits);
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Start reading and tracking camera frames on a dedicated thread
+//--------------------------------------------------------------------------------------
+bool Tracker::StartCaptureThread(FrameDropPolicy policy) {
+
+    if (capturing || !source || !source->isOpened()) {
+        return false;
+    }
+
+    dropPolicy = policy;
+    capturing = true;
+    captureThread = std::thread(&Tracker::CaptureLoop, this);
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Stop the capture thread and wait for it to finish its current frame
+//--------------------------------------------------------------------------------------
+void Tracker::StopCaptureThread() {
+
+    capturing = false;
+    if (captureThread.joinable()) {
+        captureThread.join();
+    }
+
+}
+
 //--------------------------------------------------------------------------------------
 // Poll the camera for updated tracking information
 //--------------------------------------------------------------------------------------
 void Tracker::UpdateCamera() {
 
-    // If a new frame can't be read, return
-    if (!webcam.read(frame)) {
-        return;
+    if (capturing) {
+        // Pick up the newest results from the capture thread, if it has published any
+        if (!snapshots.update()) {
+            return;
+        }
+    } else {
+        // If a new frame can't be read, return
+        double timestamp;
+        if (!ReadLatestFrame(frame, timestamp, DROP_NONE)) {
+            return;
+        }
+        TrackFrame(frame, frameResults);
+        for (size_t i = 0; i < frameResults.size(); i++) {
+            frameResults[i].timestamp = timestamp;
+        }
+        ViewFrame(frame, frameResults);
+    }
+    UpdateResults(capturing ? snapshots.readBuffer().results : frameResults);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Take on a frame's results, and fold them into the motion filters
+//--------------------------------------------------------------------------------------
+void Tracker::UpdateResults(const vector<TrackResult> &results) {
+
+    targets.results.assign(results.begin(), results.end());
+    for (size_t i = 0; i < targets.size(); i++) {
+        targets.filters[i].update(results[i]);
+    }
+
+}
+
+//--------------------------------------------------------------------------------------
+// Read and track the next frame, without the capture thread
+//--------------------------------------------------------------------------------------
+bool Tracker::TrackNextFrame(vector<TrackResult> &results, double &timestamp, FrameDropPolicy policy) {
+
+    if (capturing || !source || !ReadLatestFrame(frame, timestamp, policy)) {
+        return false;
+    }
+
+    TrackFrame(frame, results);
+    for (size_t i = 0; i < results.size(); i++) {
+        results[i].timestamp = timestamp;
+    }
+    ViewFrame(frame, results);
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Run the colour tracking pipeline on a camera frame
+//--------------------------------------------------------------------------------------
+void Tracker::TrackFrame(cv::Mat &frame, vector<TrackResult> &results) {
+
+    // See the image as mirror. YUYV frames are borrowed from the camera, so are tracked as they
+    // are, with the last results taken back into their coordinates and the new ones mirrored after.
+    const bool unmirrored = frame.type() == CV_8UC2;
+    if (unmirrored) {
+        mirrorResults(results, frame.cols);
+    } else {
+        cv::flip(frame, frame, 1);
+    }
+
+    // Colour recognition of every target, sharing one back projection pass over the frame.
+    // YUYV frames can only be looked up, through tables ready since the camera opened.
+    const vector<BackProjectLUT> *lookup = lookupBackProjection ? &targets.luts : nullptr;
+    if (frame.type() == CV_8UC2) {
+        lookup = &targets.yuyvLuts;
     }
 
-    // See the image as mirror
-    cv::flip(frame, frame, 1);
+    // Swap in the histograms and tables adapted since the last frame, starting the adapter
+    // once the tables it patches are baked
+    if (histogramAdaptation) {
+        if (!adapter.isRunning()) {
+            adapter.start(targets);
+        }
+        adapter.apply(targets);
+    } else if (adapter.isRunning()) {
+        adapter.stop();
+    }
+    workspace.stripes = parallelStripes;
+    workspace.incremental = incrementalLabelling;
+    workspace.maxDirtyRatio = maxDirtyRatio;
+    workspace.profiler = profiling ? &profiler : nullptr;
+    workspace.reserve(frame.size(), targets.size());
+
+    // Only look again where something moved
+    MotionGate *gate = nullptr;
+    if (motionGating) {
+        motionGate.update(frame);
+        gate = &motionGate;
+    } else {
+        motionGate.reset();
+    }
 
-    // Green Colour recognition
-    if (hist_green.data) {
-        updateTrackAndSize(frame, hist_green, tracker_green, size_green);
+    if (windowedTracking) {
+        updateTracksAndSizes(frame, targets.hists, results, windows, pyramidLevel, lookup, &workspace, gate);
+    } else {
+        updateTracksAndSizes(frame, targets.hists, results, pyramidLevel, lookup, &workspace, gate);
+        windows.clear();
     }
-    // Red Colour recognition
-    if (hist_red.data) {
-        updateTrackAndSize(frame, hist_red, tracker_red, size_red);
+
+    // Every buffer was sized for the frame up front, so nothing should have been allocated
+    CV_DbgAssert(workspace.allocationCount() == 0);
+
+    adapter.fold(frame, results, windows);
+    if (unmirrored) {
+        mirrorResults(results, frame.cols);
     }
 
 }
 
 //--------------------------------------------------------------------------------------
-// Display the camera input, with related tracking info
+// Read a frame from the camera, applying the frame drop policy
 //--------------------------------------------------------------------------------------
-void Tracker::ShowCameraWindow() {
+bool Tracker::ReadLatestFrame(cv::Mat &frame, double &timestamp, FrameDropPolicy policy) {
 
-    // Get green ball tracking info
-    std::string result_green = getTrackerString("Green", tracker_green, size_green);
-    cv::putText(frame, result_green, cv::Point(10, 20), 1, 1, cv::Scalar(0, 255, 255), 1);
-    cv::putText(frame, "+", tracker_green, 1, 3, cv::Scalar(0, 255, 0), 2);
+    double start = now();
+    if (!source->grab(timestamp)) {
+        return false;
+    }
 
-    // Get red ball tracking data
-    std::string result_red = getTrackerString("Red", tracker_red, size_red);
-    cv::putText(frame, result_red, cv::Point(10, 40), 1, 1, cv::Scalar(0, 255, 255), 1);
-    cv::putText(frame, "+", tracker_red, 1, 3, cv::Scalar(0, 0, 255), 2);
+    if (policy == DROP_STALE && source->isLive()) {
+        // Frames that were waiting for us are already out of date, so keep grabbing until
+        // one has to be waited for. How long a grab blocked is timed here, as drivers may
+        // stamp frames with when they started, before the grab was even called.
+        int dropped = 0;
+        while ((now() - start) * 1000.0 < staleGrabTime && dropped < maxStaleFrames) {
+            start = now();
+            if (!source->grab(timestamp)) {
+                return false;
+            }
+            dropped++;
+        }
+        droppedFrames += dropped;
+    }
 
-    // Show the camera tracker window
-    cv::imshow("Green & Red", frame);
+    return rawCapture ? source->retrieveRaw(frame) : source->retrieve(frame);
 
 }
 
 //--------------------------------------------------------------------------------------
-// Returns a string containing the tracking data for a provided object
+// Capture thread, tracking frames as they arrive and publishing the results
 //--------------------------------------------------------------------------------------
-std::string Tracker::getTrackerString(std::string col, cv::Point point, cv::Size size) {
+void Tracker::CaptureLoop() {
+
+    cv::Mat captured;
+    double timestamp;
+    vector<TrackResult> results;
+    unsigned long frameNumber = 0;
+
+    while (capturing) {
+        if (!ReadLatestFrame(captured, timestamp, dropPolicy)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        TrackFrame(captured, results);
+        for (size_t i = 0; i < results.size(); i++) {
+            results[i].timestamp = timestamp;
+        }
+
+        // Results the game has not read yet are simply replaced by these newer ones
+        TrackingSnapshot &snapshot = snapshots.writeBuffer();
+        snapshot.results = results;
+        snapshot.frameNumber = ++frameNumber;
+        snapshots.publish();
+
+        ViewFrame(captured, results);
+    }
 
-    std::ostringstream str;
-    str << col << " Ball - x: " << point.x << " y: " << point.y << " size: " << size.area();
-    return str.str();
+}
+
+//--------------------------------------------------------------------------------------
+// Look up a target by the name it was given in the config file
+//--------------------------------------------------------------------------------------
+bool Tracker::findTarget(const std::string &name, size_t &target) {
+
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (targets.names[i] == name) {
+            target = i;
+            return true;
+        }
+    }
+    return false;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Current time on the clock used to stamp camera frames, in seconds
+//--------------------------------------------------------------------------------------
+double Tracker::now() {
+
+    return FrameSource::now();
 
 }
 
 //--------------------------------------------------------------------------------------
-// Returns a wstring containing the tracking data for the green ball
+// Hand a tracked frame and its tracking info to the viewer, while the camera window is shown
 //--------------------------------------------------------------------------------------
-std::wstring Tracker::getGreenTrackerString() {
+void Tracker::ViewFrame(const cv::Mat &frame, const vector<TrackResult> &results) {
 
-    return getTrackerWcharString("Green", tracker_green, size_green);
+    if (!viewer.isRunning()) {
+        return;
+    }
+
+    overlays.resize(results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        overlays[i].text = formatTrackerString(i, results[i]);
+        overlays[i].marker = results[i].point;
+        overlays[i].colour = targets.colours[i];
+    }
+    // YUYV frames were tracked unmirrored, so the viewer mirrors its copy
+    viewer.submit(frame, overlays, frame.type() == CV_8UC2);
 
 }
 
 //--------------------------------------------------------------------------------------
-// Returns a wstring containing the tracking data for the red ball
+// Position of a target extrapolated to a given time
 //--------------------------------------------------------------------------------------
-std::wstring Tracker::getRedTrackerString() {
+cv::Point2f Tracker::getPosition(size_t target, double time) {
+
+    const MotionFilter &filter = targets.filters[target];
+    return filter.isValid() ? filter.predictPosition(time) : cv::Point2f(targets.results[target].point);
 
-    return getTrackerWcharString("Red", tracker_red, size_red);
+}
+
+//--------------------------------------------------------------------------------------
+// Size of a target extrapolated to a given time
+//--------------------------------------------------------------------------------------
+float Tracker::getSize(size_t target, double time) {
+
+    const MotionFilter &filter = targets.filters[target];
+    return filter.isValid() ? filter.predictSize(time) : depthArea(targets.results[target]);
+
+}
+
+//--------------------------------------------------------------------------------------
+// Returns a string containing the tracking data for a target
+//--------------------------------------------------------------------------------------
+std::string Tracker::formatTrackerString(size_t target, const TrackResult &result) {
+
+    std::ostringstream str;
+    str << targets.names[target] << " Ball - x: " << result.point.x << " y: " << result.point.y << " size: " << result.size.area();
+    return str.str();
 
 }
 
 //--------------------------------------------------------------------------------------
-// Returns a wstring containing the tracking data for a provided object
+// Returns a wstring containing the tracking data for a target
 //--------------------------------------------------------------------------------------
-std::wstring Tracker::getTrackerWcharString(std::string col, cv::Point point, cv::Size size) {
+std::wstring Tracker::getTrackerString(size_t target) {
 
-    std::string result_str = getTrackerString(col, point, size);
+    std::string result_str = formatTrackerString(target, targets.results[target]);
     return std::wstring(result_str.begin(), result_str.end());
 
 }
@@ -6,7 +6,38 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "BackProjectLUT.h"
+#include "FrameSource.h"
+#include "FrameViewer.h"
+#include "HistogramAdapter.h"
+#include "HistogramCache.h"
+#include "MotionFilter.h"
+#include "MotionGate.h"
 #include "OpenCVToolkit.h"
+#include "PipelineProfiler.h"
+#include "TargetSet.h"
+#include "TrackerParams.h"
+#include "TripleBuffer.h"
+
+//--------------------------------------------------------------------------------------
+// How the capture thread treats frames the camera queued up while it was busy tracking
+//--------------------------------------------------------------------------------------
+enum FrameDropPolicy {
+    DROP_NONE,      // Track every frame the camera delivers, in order
+    DROP_STALE,     // Discard frames that were already waiting, and track only the newest
+};
+
+//--------------------------------------------------------------------------------------
+// Tracking data published by the capture thread
+//--------------------------------------------------------------------------------------
+struct TrackingSnapshot {
+    vector<TrackResult> results;
+    unsigned long frameNumber = 0;
+};
 
 //--------------------------------------------------------------------------------------
 // This class is used for tracking objects
@@ -17,49 +48,166 @@ public:
     // Functions
     //--------------------------------------------------------------------------------------
 
-    // Constructor and Destructor
-    Tracker();
+    // Constructor and Destructor, loading the targets listed in a config file and the tracking
+    // parameters tuned for them, keeping the built in parameters without a parameter file. The
+    // debug window is shown under windowName.
+    Tracker(const std::string &targetConfig = "Histograms/targets.yml", const std::string &paramsPath = "Histograms/tracker_params.yml",
+        const std::string &windowName = "Tracker");
     ~Tracker();
 
-    // Camera data
-    bool InitCamera();
+    // Camera data. The default camera is opened through OpenCV, or with v4l2 through V4L2 in
+    // YUYV where it is available, falling back to OpenCV if the V4L2 device won't open.
+    bool InitCamera(bool v4l2 = false);
+    bool InitSource(FrameSource *frameSource);
     void UpdateCamera();
-    void ShowCameraWindow();
+
+    // For callers running their own capture thread: read and track the next frame on the calling
+    // thread, then hand its results over on the game thread. results must be the same vector each
+    // call, holding the last frame's results, which targets that didn't move keep. Live sources
+    // drop frames as the policy says, as the capture thread does.
+    bool TrackNextFrame(vector<TrackResult> &results, double &timestamp, FrameDropPolicy policy = DROP_NONE);
+    // Size of the last frame tracked, only for the thread tracking them
+    cv::Size getTrackedFrameSize() { return frame.size(); };
+    void UpdateResults(const vector<TrackResult> &results);
+
+    // Debug window of the tracked frames and their tracking info, drawn on a viewer thread
+    void ShowCameraWindow() { viewer.start(); };
+    void HideCameraWindow() { viewer.stop(); };
+    unsigned long getViewerDroppedFrames() { return viewer.getDroppedFrames(); };
+
+    // Capture thread, which reads and tracks camera frames without blocking UpdateCamera
+    bool StartCaptureThread(FrameDropPolicy policy = DROP_STALE);
+    void StopCaptureThread();
+    unsigned long getDroppedFrames() { return droppedFrames; };
+    bool isSourceLive() { return source && source->isLive(); };
+
+    // Search only around the last known positions, falling back to the full frame when a target is lost
+    void setWindowedTracking(bool enabled) { windowedTracking = enabled; };
+
+    // Detect targets on a 1/2 (level 1) or 1/4 (level 2) size frame, refining them at full resolution
+    void setPyramidLevel(int level) { pyramidLevel = std::max(0, std::min(level, 2)); };
+
+    // Split each stage into horizontal stripes run on the thread pool, and track targets concurrently.
+    // 0 uses a stripe per thread, 1 runs the pipeline serially.
+    void setParallelStripes(int stripes) { parallelStripes = stripes > 0 ? stripes : cv::getNumThreads(); };
+
+    // Label only the parts of each target's mask that changed since the last frame, labelling it
+    // all again when more than maxDirtyRatio of it changed
+    void setIncrementalLabelling(bool enabled, float maxDirtyRatio = 0.25f) { incrementalLabelling = enabled; this->maxDirtyRatio = maxDirtyRatio; };
+
+    // Back project frames through lookup tables baked from the histograms, skipping the HSV conversion
+    void setLookupBackProjection(bool enabled) { lookupBackProjection = enabled; };
+
+    // Track frames in the layout the camera delivers them, such as YUYV, without decoding them to BGR first
+    void setRawCapture(bool enabled) { rawCapture = enabled; };
+
+    // Keep adapting the targets' histograms to the lighting from the targets held steadily in their
+    // search windows, so only with windowed tracking, on a thread of its own and within a fixed
+    // budget on the tracking thread. Stopping keeps what was adapted.
+    void setHistogramAdaptation(bool enabled) { histogramAdaptation = enabled; };
+    unsigned long getAdaptedFrames() { return adapter.getFoldedFrames(); };
+
+    // Skip the colour pipeline where nothing moved since the last frame, keeping the last results there
+    void setMotionGating(bool enabled) { motionGating = enabled; };
+    // Fraction of target updates the motion gate skipped
+    double getSkipRatio() { return motionGate.getSkipRatio(); };
+
+    // Workspace buffers that had to grow after being sized for the frame, which should stay at zero
+    unsigned long getWorkspaceAllocations() { return workspace.allocationCount(); };
+
+    // Per-stage pipeline timings of this tracker, taken from the next frame tracked
+    void setProfiling(bool enabled) { profiling = enabled; };
+    StageStats getStageStats(PipelineStage stage) { return profiler.getStats(stage); };
+    bool dumpStageStats(const std::string &path) { return profiler.writeCsv(path); };
+
+    // Thresholds, bin counts and kernel sizes tracking runs with
+    const TrackerParams &getParams() { return params; };
+
+    // Tracked targets, in the order of the config file
+    size_t getTargetCount() { return targets.size(); };
+    const std::string &getTargetName(size_t target) { return targets.names[target]; };
+    // Index of the target with a name, or false if there is none
+    bool findTarget(const std::string &name, size_t &target);
+    const vector<TrackResult> &getResults() { return targets.results; };
 
     // Ball tracking data
-    cv::Point getGreenPosition() { return tracker_green; };
-    cv::Point getRedPosition() { return tracker_red; };
-    int getGreenSize() { return size_green.area(); };
-    int getRedSize() { return size_red.area(); };
+    cv::Point getPosition(size_t target) { return targets.results[target].point; };
+    int getSize(size_t target) { return (int)depthArea(targets.results[target]); };
 
-    // Ball tracking strings
-    std::wstring getGreenTrackerString();
-    std::wstring getRedTrackerString();
+    // Ball tracking data extrapolated to a given time, hiding the camera and tracking latency
+    static double now();
+    cv::Point2f getPosition(size_t target, double time);
+    float getSize(size_t target, double time);
+
+    // Ball tracking string
+    std::wstring getTrackerString(size_t target);
 
     // Tracking area
-    cv::Size frameSize = frameSize;
+    cv::Size frameSize = ::frameSize;
 
 private:
     //--------------------------------------------------------------------------------------
     // Variables
     //--------------------------------------------------------------------------------------
 
-    // Histograms
-    cv::MatND hist_green = cv::Mat::zeros(cv::Size(sbins, hbins), CV_32F);
-    cv::MatND hist_red = cv::Mat::zeros(cv::Size(sbins, hbins), CV_32F);
+    // Camera input
+    std::unique_ptr<FrameSource> source;
+    cv::Mat frame;
+    std::atomic<bool> rawCapture;
+
+    // Capture thread state
+    std::thread captureThread;
+    std::atomic<bool> capturing;
+    std::atomic<unsigned long> droppedFrames;
+    FrameDropPolicy dropPolicy = DROP_STALE;
+    TripleBuffer<TrackingSnapshot> snapshots;
 
-    // Colour tracking
-    cv::Point tracker_green;
-    cv::Point tracker_red;
+    // Search windows around the last known positions
+    std::atomic<bool> windowedTracking;
+    vector<TrackWindow> windows;
 
-    // Colour depth
-    cv::Size size_green;
-    cv::Size size_red;
+    // Detection resolution
+    std::atomic<int> pyramidLevel;
+
+    // Frame differencing in front of the colour pipeline
+    std::atomic<bool> motionGating;
+    MotionGate motionGate;
+
+    // Debug window, fed from whichever thread tracks the frames
+    FrameViewer viewer;
+    vector<ViewerOverlay> overlays;
+
+    // Stage timings
+    std::atomic<bool> profiling;
+    PipelineProfiler profiler;
+
+    // Back project through the targets' lookup tables
+    std::atomic<bool> lookupBackProjection;
+
+    // Histograms and tables following the lighting
+    std::atomic<bool> histogramAdaptation;
+    HistogramAdapter adapter;
+
+    // Histograms, lookup tables, latest results and motion filters of every target
+    TargetSet targets;
+    TrackerParams params;
+
+    // Intermediate buffers, reused every frame
+    TrackerWorkspace workspace;
+    std::atomic<int> parallelStripes;
+    std::atomic<bool> incrementalLabelling;
+    std::atomic<float> maxDirtyRatio;
+    vector<TrackResult> frameResults;
 
     //--------------------------------------------------------------------------------------
     // Functions
     //--------------------------------------------------------------------------------------
 
-    std::string getTrackerString(std::string col, cv::Point point, cv::Size size);
-    std::wstring getTrackerWcharString(std::string col, cv::Point point, cv::Size size);
+    void PrepareSource();
+    void TrackFrame(cv::Mat &frame, vector<TrackResult> &results);
+    bool ReadLatestFrame(cv::Mat &frame, double &timestamp, FrameDropPolicy policy);
+    void CaptureLoop();
+    void ViewFrame(const cv::Mat &frame, const vector<TrackResult> &results);
+
+    std::string formatTrackerString(size_t target, const TrackResult &result);
 };
@@ -1,46 +1,32 @@
-#include <opencv2\imgproc\imgproc.hpp>
-#include <opencv2\highgui\highgui.hpp>
-#include <opencv2\opencv.hpp>
-#include <iostream>
-#include <vector>
+//--------------------------------------------------------------------------------------
+// File: Source.cpp
+//
+// Colour histogram trainer. Run without arguments, samples a colour interactively from
+// the webcam. Given a recording and its annotations, trains a histogram headlessly from
+// the annotated boxes, then reports how the tracker does with it on held out frames.
+// Given a parameter file to write, sweeps the tracking parameters on the held out frames
+// instead, keeping the cheapest setting that reaches an accuracy bar. Given a target config
+// as well, sweeps every target it lists together, as the game tracks them, and writes each
+// target's histogram where the config says.
+//
+// Usage: Define_colour
+//        Define_colour <clip|image pattern|directory> <annotations.csv> [-o histogram.yml]
+//                      [-k holdoutEvery] [-f] [-t params.yml [-c targets.yml]] [-a minF1]
+//--------------------------------------------------------------------------------------
+
+#include <fstream>
+#include <map>
+#include <memory>
+
+#include "../Code/BackProjectLUT.h"
+#include "../Code/FrameSource.h"
+#include "../Code/OpenCVToolkit.h"
+#include "../Code/TrackerParams.h"
 
-using namespace std;
 using namespace cv;
 
-//////////////////////////////////////////
-//Global variations and demo parameters///
-//////////////////////////////////////////
-
-//camera setting
-const Size frameSize = Size(640, 480);
-
-//Colour generator seting
-const vector<Mat>::size_type sampleNum = 6;
-
-//Preprocessing bilateral filter
-const int fsize = 3;
-
-// Build the histogram and compute its contents.
-// Dimension of the histogram
-const int dim = 2;
-// 2 image channels (H, S)
-int hsv_channels[] = { 0, 1 };
-//Number of bins
-const int hbins = 50; //number of bins for H
-const int sbins = 50; //number of bins for S
-int histSize[] = { hbins, sbins };
-//Range of rach channels
-float h_ranges[] = { 0.0, 255.0 };
-float s_ranges[] = { 0.0, 255.0 };
-const float* ranges[] = { h_ranges, s_ranges };
 cv::MatND hist = Mat::zeros(Size(sbins, hbins), CV_32F);//Place to put the histgram
 
-//Region mark setting
-//Remove flood fill noise threshold
-const int thre = 100;
-//Flood fill local tolerance
-const int tolerance = 200;
-
 //Mouse events for colour
 bool clickedL = false;
 bool clickedR = false;
@@ -71,47 +57,7 @@ void mouse_callback_colour(int event, int x, int y, int, void* param)
     }
 };
 
-void regionMark(const Mat &frame, const MatND &hsv_hist, Mat &markMap)
-{
-    //Back projection operation
-    Mat hsv;
-    Mat backProject;
-    Mat binary(frameSize, CV_8UC3);
-    cvtColor(frame, hsv, CV_RGB2HSV);
-    cv::cvtColor(frame, hsv, CV_RGB2HSV);
-    cv::calcBackProject(&hsv, 1, hsv_channels, hsv_hist, backProject, ranges);
-    //Remove noise
-    Mat element = getStructuringElement(MORPH_RECT, Size(3, 3));
-    erode(backProject, binary, element);
-    dilate(binary, binary, element);
-    imshow("Back Projection", binary);
-
-    //Mark regions by using flood fill			
-    markMap = binary.clone();
-
-    threshold(binary, markMap, thre, 255, THRESH_TOZERO);
-    //Operation mask that should be a single-channel 8-bit image, 2 pixels wider and 2 pixels taller than image
-    Mat mask = Mat::zeros(Size(frameSize.width + 2, frameSize.height + 2), CV_8UC1);
-    Mat inverseMask = mask.clone();
-    Mat maskROI = mask(Rect(1, 1, frameSize.width, frameSize.height));
-    Mat inverseMaskROI = inverseMask(Rect(1, 1, frameSize.width, frameSize.height));
-    //Mat currentMask;
-    threshold(markMap, maskROI, thre, 255, THRESH_BINARY);
-    threshold(markMap, inverseMaskROI, thre, 255, THRESH_BINARY_INV);
-    //Find marking locations
-    int index = thre + 1;
-    vector<Point> markLoc;
-    findNonZero(maskROI, markLoc);
-    while (markLoc.size() != 0)
-    {
-        Point seed = markLoc[0];
-        floodFill(markMap, inverseMask, seed, cv::Scalar(static_cast<uchar>(index++)), (cv::Rect*)0, cv::Scalar(tolerance), cv::Scalar(tolerance), 4 | (static_cast<uchar>(255) << 8));
-        bitwise_not(inverseMaskROI, maskROI);
-        findNonZero(maskROI, markLoc);
-    }
-}
-
-int main()
+static int runSampler()
 {
     VideoCapture webcam(0);
 
@@ -123,7 +69,6 @@ int main()
 
     int const delay = 30;
     bool stop = false;
-    const Size sampleSize = Size(60, 60);
 
     //UI ROIs
     Mat UI = Mat::zeros(Size(frameSize.width, frameSize.height + sampleSize.height), CV_8UC3);
@@ -132,7 +77,7 @@ int main()
     //Six regions for storing and showing sample list
     Rect SampleArea((frameSize.width - sampleSize.width) / 2, (frameSize.height - sampleSize.height) / 2, sampleSize.width, sampleSize.height);
     vector<Mat> listSample; //store
-    Mat listSampleHSV[sampleNum]; //store
+    vector<Mat> listSampleHSV(sampleNum); //store
     vector<Mat> listROI(sampleNum);//show
     for (vector<Mat>::size_type ix = 0; ix != listROI.size(); ix++)
         listROI[ix] = UI(Rect(sampleSize.width*ix + 1, frameSize.height, sampleSize.width, sampleSize.height));
@@ -205,15 +150,15 @@ int main()
             //RGB to HSV
             size_t i = 0;
             for (vector<Mat>::iterator iterSample = listSample.begin(); iterSample != listSample.end(); iterSample++) {
-                cvtColor(*iterSample, *(listSampleHSV + i), CV_RGB2HSV);
+                cvtColor(*iterSample, listSampleHSV[i], CV_RGB2HSV);
                 i++;
             }
             //Get histogram
             if (histCalc)
             {
                 hist = Mat::zeros(Size(sbins, hbins), CV_32F);
-                for (int i = 0; i != sampleNum; i++) {
-                    calcHist(listSampleHSV + i, 1, hsv_channels, cv::Mat(), hsv_hist, dim, histSize, ranges, true, false);
+                for (size_t i = 0; i != sampleNum; i++) {
+                    calcHist(&listSampleHSV[i], 1, hsv_channels, cv::Mat(), hsv_hist, dim, histSize, ranges, true, false);
                     addWeighted(hist, 1, hsv_hist, 1, 0, hist);
 
                 }
@@ -243,4 +188,527 @@ int main()
     fs.release();
 
     return 0;
-}
\ No newline at end of file
+}
+
+//--------------------------------------------------------------------------------------
+// Headless training
+//--------------------------------------------------------------------------------------
+
+// A box around a target in an annotated frame, and the target's name in recordings of several
+struct AnnotatedBox {
+    cv::Rect box;
+    std::string target;
+};
+
+// Boxes around the targets in each annotated frame, empty where they are known to be absent
+typedef std::map<int, vector<AnnotatedBox>> Annotations;
+
+// Read annotations, one box per line as "frame,x,y,width,height" or "frame,x,y,width,height,target",
+// with frames numbered from 0 in the order the source plays them. A line with only a frame number
+// marks a frame without any target. Lines that don't start with a number, such as a header, are skipped.
+static bool loadAnnotations(const std::string &path, Annotations &annotations) {
+
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) {
+        std::cout << "unable to open annotations " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        int frame, x, y, width, height;
+        char target[64] = "";
+        int fields = sscanf(line.c_str(), "%d,%d,%d,%d,%d,%63[^,\r\n]", &frame, &x, &y, &width, &height, target);
+        if (fields < 1) {
+            continue;
+        }
+        vector<AnnotatedBox> &boxes = annotations[frame];
+        if (fields >= 5 && width > 0 && height > 0) {
+            AnnotatedBox annotated;
+            annotated.box = cv::Rect(x, y, width, height);
+            annotated.target = target;
+            boxes.push_back(annotated);
+        }
+    }
+    return !annotations.empty();
+
+}
+
+// Whether an annotated frame is held out of training, to evaluate the histogram on instead.
+// Every holdoutEvery-th annotated frame is, none with 0.
+static bool isHeldOut(int annotatedIndex, int holdoutEvery) {
+
+    return holdoutEvery > 0 && annotatedIndex % holdoutEvery == holdoutEvery - 1;
+
+}
+
+// Whether an annotated box is of a target. An unnamed target is the only one, and takes every box.
+static bool isTargetBox(const AnnotatedBox &annotated, const std::string &target) {
+
+    return target.empty() || annotated.target == target;
+
+}
+
+// Training boxes and held out frames of an annotated recording, for each target
+struct Dataset {
+    vector<vector<cv::Mat>> samples;                // Boxes cut out of the training frames, by target
+    vector<cv::Mat> heldOut;                        // Held out frames, and the boxes in each by target
+    vector<vector<vector<cv::Rect>>> heldOutBoxes;
+};
+
+// Read the recording once, cutting the boxes out of the training frames and keeping the held out
+// frames in memory, so they can be tracked any number of times
+static bool loadDataset(const std::string &dataset, const Annotations &annotations, const vector<std::string> &targets, int holdoutEvery, Dataset &data) {
+
+    std::unique_ptr<FrameSource> source(openFrameSource(dataset));
+    if (!source->isOpened()) {
+        std::cout << "Cannot open " << dataset << std::endl;
+        return false;
+    }
+
+    cv::Mat frame;
+    double timestamp;
+    int annotated = 0;
+    data.samples.resize(targets.size());
+    for (int frameNumber = 0; source->read(frame, timestamp); frameNumber++) {
+        Annotations::const_iterator labels = annotations.find(frameNumber);
+        if (labels == annotations.end()) {
+            continue;
+        }
+        const bool heldOut = isHeldOut(annotated++, holdoutEvery);
+        if (heldOut) {
+            data.heldOut.push_back(frame.clone());
+            data.heldOutBoxes.push_back(vector<vector<cv::Rect>>(targets.size()));
+        }
+        for (size_t t = 0; t < targets.size(); t++) {
+            for (size_t i = 0; i < labels->second.size(); i++) {
+                if (!isTargetBox(labels->second[i], targets[t])) {
+                    continue;
+                }
+                cv::Rect box = labels->second[i].box & cv::Rect(0, 0, frame.cols, frame.rows);
+                if (heldOut) {
+                    data.heldOutBoxes.back()[t].push_back(labels->second[i].box);
+                } else if (box.area() > 0) {
+                    data.samples[t].push_back(frame(box).clone());
+                }
+            }
+        }
+    }
+    for (size_t t = 0; t < targets.size(); t++) {
+        if (data.samples[t].empty()) {
+            std::cout << "No training samples" << (targets[t].empty() ? "" : " of " + targets[t]) << " in " << dataset << std::endl;
+            return false;
+        }
+    }
+    return true;
+
+}
+
+// Histogram of each sample, computed on the thread pool
+class SampleHistograms : public cv::ParallelLoopBody {
+public:
+    SampleHistograms(const vector<cv::Mat> &samples, int hsvCode, int hbins, int sbins, vector<cv::MatND> &hists)
+        : samples(samples), hsvCode(hsvCode), hists(hists) {
+
+        bins[0] = hbins;
+        bins[1] = sbins;
+
+    }
+
+    void operator()(const cv::Range &range) const {
+        cv::Mat hsv;
+        for (int i = range.start; i < range.end; i++) {
+            cv::cvtColor(samples[i], hsv, hsvCode);
+            cv::calcHist(&hsv, 1, hsv_channels, cv::Mat(), hists[i], dim, bins, ranges, true, false);
+        }
+    }
+
+private:
+    const vector<cv::Mat> &samples;
+    int hsvCode;
+    int bins[2];
+    vector<cv::MatND> &hists;
+
+    SampleHistograms &operator=(const SampleHistograms&);
+};
+
+// Sum the samples' histograms, then scale the sum to the total of the interactive sampler's
+// six 60x60 samples, so back projections of either threshold the same
+static cv::MatND trainHistogram(const vector<cv::Mat> &samples, int hsvCode, int hbins, int sbins) {
+
+    vector<cv::MatND> sampleHists(samples.size());
+    cv::parallel_for_(cv::Range(0, (int)samples.size()), SampleHistograms(samples, hsvCode, hbins, sbins, sampleHists));
+    cv::MatND trained = cv::Mat::zeros(cv::Size(sbins, hbins), CV_32F);
+    for (size_t i = 0; i < sampleHists.size(); i++) {
+        cv::add(trained, sampleHists[i], trained);
+    }
+    double total = cv::sum(trained)[0];
+    if (total > 0.0) {
+        trained.convertTo(trained, CV_32F, (double)(sampleNum * sampleSize.area()) / total);
+    }
+    return trained;
+
+}
+
+static bool saveHistogram(const std::string &path, const cv::MatND &trained, bool hueFull) {
+
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        std::cout << "unable to open file storage " << path << std::endl;
+        return false;
+    }
+    fs << "histogram" << trained;
+    if (hueFull) {
+        fs << "hue_full" << 1;
+    }
+    fs.release();
+    return true;
+
+}
+
+// How well, and how cheaply, the held out frames were tracked
+struct Score {
+    int detections = 0;
+    int correct = 0;
+    int present = 0;
+    double precision = 0.0;
+    double recall = 0.0;
+    double f1 = 0.0;
+    double meanMs = 0.0;
+    double p95Ms = 0.0;
+    double maxMs = 0.0;
+};
+
+// Track the held out frames as the game would, every target at once through their lookup
+// tables, from scratch every frame. A detection is correct when its centre falls in one of the
+// frame's boxes of its target. Counts are summed over the targets, so the score is of them all.
+static Score evaluate(const Dataset &data, const vector<cv::MatND> &hists, const vector<BackProjectLUT> &luts, const TrackerParams &params) {
+
+    vector<TrackResult> results;
+    TrackerWorkspace workspace;
+    workspace.params = params;
+    vector<double> times;
+    Score score;
+    for (size_t frame = 0; frame < data.heldOut.size(); frame++) {
+        workspace.reserve(data.heldOut[frame].size(), hists.size());
+        int64 start = cv::getTickCount();
+        updateTracksAndSizes(data.heldOut[frame], hists, results, 0, &luts, &workspace);
+        times.push_back((cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency());
+
+        for (size_t t = 0; t < hists.size(); t++) {
+            const vector<cv::Rect> &boxes = data.heldOutBoxes[frame][t];
+            score.present += boxes.empty() ? 0 : 1;
+            if (results[t].size.area() == 0) {
+                continue;
+            }
+            score.detections++;
+            for (size_t i = 0; i < boxes.size(); i++) {
+                if (boxes[i].contains(results[t].point)) {
+                    score.correct++;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (times.empty()) {
+        return score;
+    }
+    std::sort(times.begin(), times.end());
+    for (size_t i = 0; i < times.size(); i++) {
+        score.meanMs += times[i];
+    }
+    score.meanMs /= times.size();
+    score.p95Ms = times[(times.size() * 95) / 100];
+    score.maxMs = times.back();
+    score.precision = score.detections ? (double)score.correct / score.detections : 0.0;
+    score.recall = score.present ? (double)score.correct / score.present : 0.0;
+    score.f1 = score.precision + score.recall > 0.0 ? 2.0 * score.precision * score.recall / (score.precision + score.recall) : 0.0;
+    return score;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Train a histogram from the boxes of the training frames, write it out, then track the
+// held out frames with it
+//--------------------------------------------------------------------------------------
+static int runTrainer(const std::string &dataset, const std::string &annotationsPath, const std::string &outPath, int holdoutEvery, bool hueFull) {
+
+    Annotations annotations;
+    Dataset data;
+    if (!loadAnnotations(annotationsPath, annotations) || !loadDataset(dataset, annotations, vector<std::string>(1), holdoutEvery, data)) {
+        return -1;
+    }
+    const int hsvCode = hueFull ? CV_RGB2HSV_FULL : CV_RGB2HSV;
+
+    TrackerParams params;
+    cv::MatND trained = trainHistogram(data.samples[0], hsvCode, params.hbins, params.sbins);
+    if (!saveHistogram(outPath, trained, hueFull)) {
+        return -1;
+    }
+    std::cout << "Trained " << outPath << " from " << data.samples[0].size() << " samples" << std::endl;
+
+    if (data.heldOut.empty()) {
+        std::cout << "No held out frames to evaluate on" << std::endl;
+        return 0;
+    }
+    vector<BackProjectLUT> luts(1);
+    luts[0].build(trained, 6, hsvCode);
+    Score score = evaluate(data, vector<cv::MatND>(1, trained), luts, params);
+    std::cout << "Held out frames: " << data.heldOut.size() << std::endl;
+    std::cout << "Precision: " << score.precision << " (" << score.correct << "/" << score.detections << ")" << std::endl;
+    std::cout << "Recall: " << score.recall << " (" << score.correct << "/" << score.present << ")" << std::endl;
+    std::cout << "Tracking ms per frame: mean " << score.meanMs << ", p95 " << score.p95Ms << ", max " << score.maxMs << std::endl;
+    return 0;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Parameter tuning
+//--------------------------------------------------------------------------------------
+
+// A point of the sweep, with the targets' histograms trained at its bin counts
+struct TuningConfig {
+    TrackerParams params;
+    size_t histograms;
+    Score score;
+};
+
+// Score configurations on the thread pool, each tracking serially in a workspace of its own
+class EvaluateConfigs : public cv::ParallelLoopBody {
+public:
+    EvaluateConfigs(const Dataset &data, const vector<vector<cv::MatND>> &hists, const vector<vector<BackProjectLUT>> &luts, vector<TuningConfig> &configs)
+        : data(data), hists(hists), luts(luts), configs(configs) {}
+
+    void operator()(const cv::Range &range) const {
+        for (int i = range.start; i < range.end; i++) {
+            TuningConfig &config = configs[i];
+            config.score = evaluate(data, hists[config.histograms], luts[config.histograms], config.params);
+        }
+    }
+
+private:
+    const Dataset &data;
+    const vector<vector<cv::MatND>> &hists;
+    const vector<vector<BackProjectLUT>> &luts;
+    vector<TuningConfig> &configs;
+
+    EvaluateConfigs &operator=(const EvaluateConfigs&);
+};
+
+// Whether a configuration is at least as accurate and as cheap as another, and better at one
+static bool dominates(const Score &a, const Score &b) {
+
+    return a.f1 >= b.f1 && a.meanMs <= b.meanMs && (a.f1 > b.f1 || a.meanMs < b.meanMs);
+
+}
+
+// Names of the targets a config lists, and the histogram files it loads them from
+static bool loadTargetNames(const std::string &path, vector<std::string> &names, vector<std::string> &histPaths) {
+
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        std::cout << "unable to open target config " << path << std::endl;
+        return false;
+    }
+
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    cv::FileNode list = fs["targets"];
+    for (cv::FileNodeIterator it = list.begin(); it != list.end(); ++it) {
+        names.push_back((std::string)(*it)["name"]);
+        histPaths.push_back(directory + (std::string)(*it)["histogram"]);
+    }
+    fs.release();
+
+    if (names.empty()) {
+        std::cout << "no targets listed in " << path << std::endl;
+        return false;
+    }
+    return true;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Sweep the tracking parameters over the held out frames, and write out the cheapest
+// configuration on the accuracy and cost Pareto front that meets the accuracy bar, or the
+// most accurate one if none does, along with the histograms trained at its bin counts. The
+// game tracks every target with the same parameters, so with a target config all its targets
+// are tracked and scored together, each from the annotations naming it.
+//--------------------------------------------------------------------------------------
+static int runTuner(const std::string &dataset, const std::string &annotationsPath, const std::string &outPath, const std::string &targetConfig,
+    const std::string &paramsPath, int holdoutEvery, bool hueFull, double minF1) {
+
+    // A single unnamed target without a config
+    vector<std::string> targets(1), histPaths(1, outPath);
+    if (!targetConfig.empty()) {
+        targets.clear();
+        histPaths.clear();
+        if (!loadTargetNames(targetConfig, targets, histPaths)) {
+            return -1;
+        }
+    }
+
+    Annotations annotations;
+    Dataset data;
+    if (!loadAnnotations(annotationsPath, annotations) || !loadDataset(dataset, annotations, targets, holdoutEvery, data)) {
+        return -1;
+    }
+    if (data.heldOut.empty()) {
+        std::cout << "No held out frames to tune on" << std::endl;
+        return -1;
+    }
+    const int hsvCode = hueFull ? CV_RGB2HSV_FULL : CV_RGB2HSV;
+
+    const int binCounts[] = { 16, 32, 50 };
+    const int thresholds[] = { 60, 80, 100, 120, 140 };
+    const int tolerances[] = { 200, 255 };
+    const int kernels[] = { 1, 3, 5 };
+
+    // Histograms and lookup tables only depend on the bin counts, so are shared between configurations
+    vector<vector<cv::MatND>> hists;
+    vector<vector<BackProjectLUT>> luts;
+    vector<TuningConfig> configs;
+    for (int h = 0; h < 3; h++) {
+        for (int s = 0; s < 3; s++) {
+            hists.push_back(vector<cv::MatND>());
+            luts.push_back(vector<BackProjectLUT>(targets.size()));
+            for (size_t t = 0; t < targets.size(); t++) {
+                hists.back().push_back(trainHistogram(data.samples[t], hsvCode, binCounts[h], binCounts[s]));
+                luts.back()[t].build(hists.back()[t], 6, hsvCode);
+            }
+
+            TuningConfig config;
+            config.histograms = hists.size() - 1;
+            config.params.hbins = binCounts[h];
+            config.params.sbins = binCounts[s];
+            for (int t = 0; t < 5; t++) {
+                config.params.thre = thresholds[t];
+                for (int l = 0; l < 2; l++) {
+                    config.params.tolerance = tolerances[l];
+                    for (int d = 0; d < 3; d++) {
+                        config.params.denoiseKernel = kernels[d];
+                        for (int m = 0; m < 3; m++) {
+                            config.params.maskKernel = kernels[m];
+                            configs.push_back(config);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::cout << "Sweeping " << configs.size() << " configurations of " << targets.size() << " targets over " << data.heldOut.size()
+        << " held out frames" << std::endl;
+    cv::parallel_for_(cv::Range(0, (int)configs.size()), EvaluateConfigs(data, hists, luts, configs));
+
+    // Accuracy doesn't depend on timing, but times from the sweep were taken with every thread
+    // busy, each slowed by whatever ran beside it, so can't be compared. Every configuration
+    // that could be chosen, those meeting the bar or else the most accurate, is timed again one
+    // at a time before any is pruned.
+    double bestF1 = 0.0;
+    for (size_t i = 0; i < configs.size(); i++) {
+        bestF1 = std::max(bestF1, configs[i].score.f1);
+    }
+    vector<TuningConfig> candidates;
+    for (size_t i = 0; i < configs.size(); i++) {
+        if (configs[i].score.f1 >= std::min(minF1, bestF1)) {
+            candidates.push_back(configs[i]);
+        }
+    }
+    std::cout << "Timing " << candidates.size() << " candidate configurations one at a time" << std::endl;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        candidates[i].score = evaluate(data, hists[candidates[i].histograms], luts[candidates[i].histograms], candidates[i].params);
+    }
+
+    vector<TuningConfig> front;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        bool dominated = false;
+        for (size_t j = 0; j < candidates.size() && !dominated; j++) {
+            dominated = dominates(candidates[j].score, candidates[i].score);
+        }
+        if (!dominated) {
+            front.push_back(candidates[i]);
+        }
+    }
+
+    size_t chosen = 0;
+    bool meetsBar = false;
+    std::cout << "Pareto front of the candidates:" << std::endl;
+    std::cout << "hbins,sbins,thre,tolerance,denoise_kernel,mask_kernel,precision,recall,f1,mean_ms,p95_ms" << std::endl;
+    for (size_t i = 0; i < front.size(); i++) {
+        const TrackerParams &params = front[i].params;
+        const Score &score = front[i].score;
+        std::cout << params.hbins << "," << params.sbins << "," << params.thre << "," << params.tolerance << ","
+            << params.denoiseKernel << "," << params.maskKernel << "," << score.precision << "," << score.recall << ","
+            << score.f1 << "," << score.meanMs << "," << score.p95Ms << std::endl;
+
+        const Score &best = front[chosen].score;
+        if (score.f1 >= minF1) {
+            if (!meetsBar || score.meanMs < best.meanMs) {
+                chosen = i;
+            }
+            meetsBar = true;
+        } else if (!meetsBar && score.f1 > best.f1) {
+            chosen = i;
+        }
+    }
+
+    const TuningConfig &config = front[chosen];
+    if (!meetsBar) {
+        std::cout << "No configuration reaches F1 " << minF1 << ", taking the most accurate" << std::endl;
+    }
+    if (!saveTrackerParams(paramsPath, config.params)) {
+        return -1;
+    }
+    for (size_t t = 0; t < targets.size(); t++) {
+        if (!saveHistogram(histPaths[t], hists[config.histograms][t], hueFull)) {
+            return -1;
+        }
+    }
+    std::cout << "Chose F1 " << config.score.f1 << " at " << config.score.meanMs << " ms per frame, written to " << paramsPath;
+    for (size_t t = 0; t < targets.size(); t++) {
+        std::cout << (t + 1 < targets.size() ? ", " : " and ") << histPaths[t];
+    }
+    std::cout << std::endl;
+    return 0;
+
+}
+
+int main(int argc, char **argv) {
+
+    if (argc < 2) {
+        return runSampler();
+    }
+    if (argc < 3) {
+        std::cout << "Usage: Define_colour [<clip|image pattern|directory> <annotations.csv> [-o histogram.yml] [-k holdoutEvery] [-f] [-t params.yml [-c targets.yml]] [-a minF1]]" << std::endl;
+        return -1;
+    }
+
+    std::string outPath = "../Histograms/colour_hist.yml";
+    std::string paramsPath;
+    std::string targetConfig;
+    int holdoutEvery = 5;
+    bool hueFull = false;
+    double minF1 = 0.9;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (arg == "-k" && i + 1 < argc) {
+            holdoutEvery = std::max(0, atoi(argv[++i]));
+        } else if (arg == "-f") {
+            hueFull = true;
+        } else if (arg == "-t" && i + 1 < argc) {
+            paramsPath = argv[++i];
+        } else if (arg == "-c" && i + 1 < argc) {
+            targetConfig = argv[++i];
+        } else if (arg == "-a" && i + 1 < argc) {
+            minF1 = atof(argv[++i]);
+        }
+    }
+    if (!paramsPath.empty()) {
+        return runTuner(argv[1], argv[2], outPath, targetConfig, paramsPath, holdoutEvery, hueFull, minF1);
+    }
+    return runTrainer(argv[1], argv[2], outPath, holdoutEvery, hueFull);
+
+}
@@ -0,0 +1,171 @@
+//--------------------------------------------------------------------------------------
+// File: Source.cpp
+//
+// Headless game simulation. Plays rounds against a scripted player as fast as the CPU
+// allows, reporting the score distribution and a checksum of every round, so the rules
+// can be balanced and changes to them compared between builds. Needs neither Direct3D nor
+// the cameras.
+//
+// Usage: Simulate [-n rounds] [-s seed] [-v gloveSpeed] [-r reactionMs] [-j aimJitter]
+//                 [-T roundTime] [-S] [-o rounds.csv]
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "../Code/Simulation.h"
+
+//--------------------------------------------------------------------------------------
+// Scripted player, punching at each target with one glove after a reaction time. It aims
+// off the target by up to aimJitter units, so not every punch lands.
+//--------------------------------------------------------------------------------------
+struct Player {
+    float speed;                // Units/s the glove moves at
+    float reaction;             // s before a new target is punched at
+    float aimJitter;
+
+    GameRandom random;
+    Vec3 aim;
+    Vec3 lastTarget;
+    float waited;
+
+    Player(float speed, float reaction, float aimJitter, uint64_t seed)
+        : speed(speed), reaction(reaction), aimJitter(aimJitter), random(seed), waited(0.f) {};
+
+    void move(const GameState &state, float dt, GameInput &input) {
+
+        Vec3 &glove = input.gloves[GLOVE_RED];
+        if (state.target.x != lastTarget.x || state.target.y != lastTarget.y || state.target.z != lastTarget.z) {
+            lastTarget = state.target;
+            aim = Vec3(state.target.x + random.uniform(-aimJitter, aimJitter), state.target.y + random.uniform(-aimJitter, aimJitter),
+                state.target.z + random.uniform(-aimJitter, aimJitter));
+            waited = 0.f;
+        }
+        waited += dt;
+        if (waited < reaction) {
+            return;
+        }
+
+        Vec3 d(aim.x - glove.x, aim.y - glove.y, aim.z - glove.z);
+        float distance = std::sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+        float travel = speed * dt;
+        if (distance <= travel) {
+            glove = aim;
+        } else {
+            glove = lerp(glove, aim, travel / distance);
+        }
+
+    };
+};
+
+int main(int argc, char **argv) {
+
+    int rounds = 10000;
+    uint64_t seed = 1;
+    float speed = 20.f;
+    float reactionMs = 250.f;
+    float aimJitter = 0.5f;
+    float roundTime = 10.f;
+    bool stereoBounds = false;
+    std::string roundsPath;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            rounds = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-s" && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-v" && i + 1 < argc) {
+            speed = (float)atof(argv[++i]);
+        } else if (arg == "-r" && i + 1 < argc) {
+            reactionMs = (float)atof(argv[++i]);
+        } else if (arg == "-j" && i + 1 < argc) {
+            aimJitter = (float)atof(argv[++i]);
+        } else if (arg == "-T" && i + 1 < argc) {
+            roundTime = (float)atof(argv[++i]);
+        } else if (arg == "-S") {
+            stereoBounds = true;
+        } else if (arg == "-o" && i + 1 < argc) {
+            roundsPath = argv[++i];
+        } else {
+            std::cout << "Usage: Simulate [-n rounds] [-s seed] [-v gloveSpeed] [-r reactionMs] [-j aimJitter] [-T roundTime] [-S] [-o rounds.csv]" << std::endl;
+            return -1;
+        }
+    }
+
+    GameRules rules;
+    rules.roundTime = roundTime;
+    Simulation simulation(seed, rules);
+
+    std::ofstream roundsFile;
+    if (!roundsPath.empty()) {
+        roundsFile.open(roundsPath.c_str());
+        if (!roundsFile.is_open()) {
+            std::cout << "unable to open " << roundsPath << std::endl;
+            return -1;
+        }
+        roundsFile << "round,seed,score,hits,steps" << std::endl;
+    }
+
+    // FNV-1a over every round's score and length, which changes with any change to the rules
+    uint64_t checksum = 0xCBF29CE484222325ULL;
+    double totalScore = 0.0, totalSquares = 0.0, totalHits = 0.0;
+    int minScore = 0, maxScore = 0;
+    unsigned long long steps = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        // Each round from a seed of its own, so any one can be replayed alone
+        uint64_t roundSeed = seed + round;
+        simulation.reset(roundSeed);
+        Player player(speed, reactionMs / 1000.f, aimJitter, roundSeed ^ 0x5DEECE66DULL);
+
+        GameInput input;
+        input.gloves[GLOVE_RED] = input.gloves[GLOVE_GREEN] = Vec3(0.f, 0.f, 4.f);
+        // -S plays as if both cameras triangulated the gloves on every step
+        input.triangulated[GLOVE_RED] = input.triangulated[GLOVE_GREEN] = stereoBounds;
+        input.start = true;
+        simulation.step(input);
+        input.start = false;
+        while (simulation.getState().playing) {
+            player.move(simulation.getState(), (float)simulation.getTimestep(), input);
+            simulation.step(input);
+        }
+
+        const GameState &state = simulation.getState();
+        totalScore += state.score;
+        totalSquares += (double)state.score * state.score;
+        totalHits += state.hits;
+        minScore = round == 0 ? state.score : std::min(minScore, state.score);
+        maxScore = round == 0 ? state.score : std::max(maxScore, state.score);
+        steps += state.step;
+
+        const uint64_t values[] = { (uint64_t)state.score, (uint64_t)state.hits, (uint64_t)state.step };
+        for (int v = 0; v < 3; v++) {
+            for (int byte = 0; byte < 8; byte++) {
+                checksum = (checksum ^ ((values[v] >> (byte * 8)) & 0xFF)) * 0x100000001B3ULL;
+            }
+        }
+
+        if (roundsFile.is_open()) {
+            roundsFile << round << "," << roundSeed << "," << state.score << "," << state.hits << "," << state.step << std::endl;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double meanScore = totalScore / rounds;
+    double deviation = std::sqrt(std::max(totalSquares / rounds - meanScore * meanScore, 0.0));
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << rounds << " rounds, " << steps << " steps in " << seconds << " s (" << rounds / std::max(seconds, 1e-9) << " rounds/s)" << std::endl;
+    std::cout << "score mean " << meanScore << " sd " << deviation << " min " << minScore << " max " << maxScore << std::endl;
+    std::cout << "hits per round " << totalHits / rounds << std::endl;
+    std::cout << "checksum " << std::hex << checksum << std::dec << std::endl;
+
+    return 0;
+
+}